@@ -20,10 +20,18 @@
 #ifndef HEADER_TINYGETTEXT_DICTIONARY_HPP
 #define HEADER_TINYGETTEXT_DICTIONARY_HPP
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
+#include "entry_table.hpp"
+#include "miss_tracker.hpp"
 #include "plural_forms.hpp"
 
 namespace tinygettext {
@@ -34,20 +42,75 @@ namespace tinygettext {
 class Dictionary
 {
 private:
-  typedef std::unordered_map<std::string, std::vector<std::string> > Entries;
-  Entries entries;
+  EntryTable entries;
 
-  typedef std::unordered_map<std::string, Entries> CtxtEntries;
-  CtxtEntries ctxt_entries;
+  /** Entries with a msgctxt, all contexts share a single table */
+  EntryTable ctxt_entries;
 
   std::string charset;
   PluralForms plural_forms;
 
-  std::string translate(const Entries& dict, const std::string& msgid) const;
-  std::string translate_plural(const Entries& dict, const std::string& msgid, const std::string& msgidplural, int num) const;
-
   bool m_has_fallback;
-  Dictionary* m_fallback;
+  const Dictionary* m_fallback;
+
+  /** Keeps m_fallback alive when it is shared */
+  std::shared_ptr<const Dictionary> m_fallback_owner;
+
+  std::shared_ptr<MissTracker> miss_tracker;
+
+  /** Whether translations marked as fuzzy are used, they are kept
+      either way */
+  std::atomic<bool> use_fuzzy;
+
+  /** Copies of this dictionary converted to other charsets, made on
+      first use by get_view(), null for a charset iconv can't convert
+      to */
+  typedef std::unordered_map<std::string, std::unique_ptr<Dictionary> > Views;
+  mutable std::mutex views_mutex;
+  mutable Views views;
+
+  Dictionary* find_view(const std::string& charset) const;
+
+  /** Store a translation in \a entry, the last one added wins, but a
+      finished translation replaced by a fuzzy one is kept and used
+      while fuzzy translations are disabled */
+  void add_entry(EntryTable::Entry& entry, const std::string_view* msgctxt,
+                 std::string_view msgid, std::string_view msgid_plural,
+                 const std::vector<std::string>& msgstrs, bool fuzzy);
+  void add_entry(EntryTable::Entry& entry, const std::string_view* msgctxt,
+                 std::string_view msgid, std::string_view msgstr, bool fuzzy);
+
+  /** Store \a msgstrs in \a entry like add_entry(), \a msgstrs gets
+      the previous translation, empty if there was none */
+  static void store_entry(EntryTable::Entry& entry, std::vector<std::string>& msgstrs, bool fuzzy);
+
+  /** Like store_entry(), but \a msgstrs holds a translation without
+      plural forms, which only replaces the first one of \a entry.
+      Returns true if that differs from the previous one. */
+  static bool store_singular(EntryTable::Entry& entry, std::vector<std::string>& msgstrs, bool fuzzy);
+
+  /** Like add_entry(), but takes the translation from \a other_entry */
+  static void merge_entry(EntryTable::Entry& entry, EntryTable::Entry& other_entry);
+
+  /** Log that a translation of \a msgid replaced a different one */
+  static void collision(const std::string_view* msgctxt, std::string_view msgid, std::string_view msgid_plural,
+                        const std::vector<std::string>& old_msgstrs, const std::vector<std::string>& msgstrs);
+
+  void merge_plural_forms(const Dictionary& other);
+
+  /** Record or log that \a msgid couldn't be translated */
+  void missed(std::optional<std::string_view> msgctxt,
+              std::string_view msgid, std::string_view msgid_plural) const;
+
+  /** Look up \a msgid, in context \a msgctxt if one is given, along
+      the fallback chain, \a dict is set to the Dictionary in which
+      the translation was found */
+  std::optional<EntryTable::Msgstrs> find(std::optional<std::string_view> msgctxt, std::string_view msgid,
+                                          const Dictionary*& dict) const;
+
+  std::string_view translate(std::optional<std::string_view> msgctxt, std::string_view msgid) const;
+  std::string_view translate_plural(std::optional<std::string_view> msgctxt,
+                                    std::string_view msgid, std::string_view msgidplural, int num) const;
 
 public:
   /** Constructs a dictionary converting to the specified \a charset (default UTF-8) */
@@ -61,69 +124,202 @@ public:
   PluralForms get_plural_forms() const;
 
 
-  /** Translate the string \a msgid. */
-  std::string translate(const std::string& msgid) const;
+  /** Translate the string \a msgid. The arguments of the translate
+      functions are taken as std::string_view, so passing a string
+      literal does not allocate a temporary std::string. */
+  std::string translate(std::string_view msgid) const;
 
   /** Translate the string \a msgid to its correct plural form, based
       on the number of items given by \a num. \a msgid_plural is \a msgid in
       plural form. */
-  std::string translate_plural(const std::string& msgid, const std::string& msgidplural, int num) const;
+  std::string translate_plural(std::string_view msgid, std::string_view msgidplural, int num) const;
 
   /** Translate the string \a msgid that is in context \a msgctx. A
       context is a way to disambiguate msgids that contain the same
       letters, but different meaning. For example "exit" might mean to
       quit doing something or it might refer to a door that leads
       outside (i.e. 'Ausgang' vs 'Beenden' in german) */
-  std::string translate_ctxt(const std::string& msgctxt, const std::string& msgid) const;
+  std::string translate_ctxt(std::string_view msgctxt, std::string_view msgid) const;
 
-  std::string translate_ctxt_plural(const std::string& msgctxt, const std::string& msgid, const std::string& msgidplural, int num) const;
+  std::string translate_ctxt_plural(std::string_view msgctxt, std::string_view msgid, std::string_view msgidplural, int num) const;
+
+  /** The *_view() variants of the translate functions return a view
+      instead of a copy. A translation found in the dictionary is a
+      view into the Dictionary's storage and remains valid until the
+      Dictionary (or its fallback) is modified or destroyed. When no
+      translation is found, the \a msgid or \a msgidplural argument
+      itself is returned, so the result must then not outlive it. */
+  std::string_view translate_view(std::string_view msgid) const;
+  std::string_view translate_plural_view(std::string_view msgid, std::string_view msgidplural, int num) const;
+  std::string_view translate_ctxt_view(std::string_view msgctxt, std::string_view msgid) const;
+  std::string_view translate_ctxt_plural_view(std::string_view msgctxt, std::string_view msgid, std::string_view msgidplural, int num) const;
 
   /** Add a translation from \a msgid to \a msgstr to the dictionary,
       where \a msgid is the singular form of the message, msgid_plural the
       plural form and msgstrs a table of translations. The right
       translation will be calculated based on the \a num argument to
       translate(). */
-  void add_translation(const std::string& msgid, const std::string& msgid_plural,
+  void add_translation(std::string_view msgid, std::string_view msgid_plural,
                        const std::vector<std::string>& msgstrs);
-  void add_translation(const std::string& msgctxt,
-                       const std::string& msgid, const std::string& msgid_plural,
+  void add_translation(std::string_view msgctxt,
+                       std::string_view msgid, std::string_view msgid_plural,
                        const std::vector<std::string>& msgstrs);
 
   /** Add a translation from \a msgid to \a msgstr to the
-      dictionary */
-  void add_translation(const std::string& msgid, const std::string& msgstr);
-  void add_translation(const std::string& msgctxt, const std::string& msgid, const std::string& msgstr);
+      dictionary. If \a msgid already has plural forms, only the first
+      one is replaced. */
+  void add_translation(std::string_view msgid, std::string_view msgstr);
+  void add_translation(std::string_view msgctxt, std::string_view msgid, std::string_view msgstr);
+
+  /** Like add_translation(), but marks the translation as fuzzy, it
+      is then only used while fuzzy translations are enabled. If it
+      replaces a translation that isn't fuzzy, that one is kept and
+      used while they are disabled. */
+  void add_fuzzy_translation(std::string_view msgid, std::string_view msgid_plural,
+                             const std::vector<std::string>& msgstrs);
+  void add_fuzzy_translation(std::string_view msgctxt,
+                             std::string_view msgid, std::string_view msgid_plural,
+                             const std::vector<std::string>& msgstrs);
+  void add_fuzzy_translation(std::string_view msgid, std::string_view msgstr);
+  void add_fuzzy_translation(std::string_view msgctxt, std::string_view msgid, std::string_view msgstr);
 
-  /** Iterate over all messages, Func is of type:
+  /** Like add_translation() or add_fuzzy_translation(), in context \a
+      msgctxt if one is given, but a translation that is replaced
+      isn't logged, \a msgstrs is swapped with it instead and is empty
+      afterwards if there was none. Returns true if it differs from
+      the new one, this lets POParser report duplicate entries
+      itself. If \a singular, \a msgstrs holds a translation without
+      plural forms, which like add_translation(msgid, msgstr) only
+      replaces the first one, and only a different first one counts. */
+  bool store_translation(std::optional<std::string_view> msgctxt, std::string_view msgid,
+                         std::vector<std::string>& msgstrs, bool fuzzy, bool singular = false);
+
+  /** Remove the translation of \a msgid, returns false if there was
+      none */
+  bool remove_translation(std::string_view msgid);
+  bool remove_translation(std::string_view msgctxt, std::string_view msgid);
+
+  /** Enable or disable the use of fuzzy translations, this only
+      changes which translations lookups see and can be done at any
+      time, also while other threads are translating */
+  void set_use_fuzzy(bool t);
+  bool get_use_fuzzy() const { return use_fuzzy.load(std::memory_order_relaxed); }
+
+  /** Return this dictionary with all translations converted to \a
+      charset. The conversion is done once per charset, later calls
+      return the same view, so a dictionary loaded once can serve
+      clients using different charsets. The fallback of the view is
+      the view of the fallback in the same charset. A view is a copy,
+      translations added to the dictionary afterwards are not part
+      of it, it lives as long as the dictionary does. If iconv can't
+      convert to \a charset, a warning is logged and the dictionary
+      itself is returned. Note that iconv adds a byte order mark for
+      "UTF-16", use "UTF-16LE" or "UTF-16BE" to get plain strings. */
+  Dictionary& get_view(const std::string& charset);
+  const Dictionary& get_view(const std::string& charset) const;
+
+  /** Compact the dictionary into a read-only layout that stores all
+      strings in a single contiguous block, call this once all
+      translations are added. Adding further translations is still
+      possible, but expensive, as it undoes the compaction. If \a
+      perfect_hash is set, a minimal perfect hash function is built
+      for the lookups. */
+  void freeze(bool perfect_hash = false);
+  bool is_frozen() const;
+
+  /** Iterate over all messages, with the translations a lookup
+      would return, i.e. fuzzy ones only if they are enabled, Func is
+      of type:
       void func(const std::string& msgid, const std::vector<std::string>& msgstrs) */
   template<class Func>
   Func foreach(Func func)
   {
-    for(Entries::iterator i = entries.begin(); i != entries.end(); ++i)
-    {
-      func(i->first, i->second);
-    }
+    const bool fuzzy_ok = get_use_fuzzy();
+    entries.foreach_entry([&func, fuzzy_ok](const EntryTable::Entry& entry) {
+      const std::vector<std::string>& msgstrs = (fuzzy_ok || !entry.fuzzy) ? entry.msgstrs : entry.finished;
+      if (!msgstrs.empty() || !entry.fuzzy)
+        func(entry.key, msgstrs);
+    });
     return func;
   }
 
+  /** Translations missing in this dictionary are looked up in \a
+      fallback, which in turn may have a fallback of its own */
   void addFallback(Dictionary* fallback)
   {
       m_has_fallback = true;
       m_fallback = fallback;
+      m_fallback_owner.reset();
+  }
+
+  /** Like addFallback(Dictionary*), but keeps \a fallback alive for
+      as long as this dictionary exists */
+  void addFallback(std::shared_ptr<const Dictionary> fallback)
+  {
+      m_has_fallback = true;
+      m_fallback = fallback.get();
+      m_fallback_owner = std::move(fallback);
   }
 
-  /** Iterate over all messages with a context, Func is of type:
+  /** Misses are recorded in \a tracker instead of being logged
+      one by one, pass nullptr to go back to logging */
+  void set_miss_tracker(std::shared_ptr<MissTracker> tracker) { miss_tracker = std::move(tracker); }
+  std::shared_ptr<MissTracker> get_miss_tracker() const { return miss_tracker; }
+
+  /** Add all translations of \a other, replacing existing ones, the
+      same as if the .po file of \a other was parsed into this
+      dictionary after its own, except that replaced translations
+      aren't logged and that all plural forms of a translation are
+      replaced, also by one that has none */
+  void merge(const Dictionary& other);
+
+  /** Like merge() above, but takes over the entries of \a other
+      instead of copying them, \a other is left empty */
+  void merge(Dictionary&& other);
+
+  /** Called for each translation of the other dictionary that
+      replaces an existing one, before it does, and may still change
+      it in \a other_entry. \a other_index is its position among the
+      entries of the other dictionary with or without context,
+      depending on \a has_ctxt, in the order they were added. */
+  typedef std::function<void (const EntryTable::Entry& entry, EntryTable::Entry& other_entry,
+                              bool has_ctxt, size_t other_index)> MergeCallback;
+
+  /** Like merge() above, but tells \a replaced about the translations
+      that are replaced, e.g. to report duplicates */
+  void merge(Dictionary&& other, const MergeCallback& replaced);
+
+  /** Replace the translations of this dictionary with those of \a
+      base, except the ones in \a removed, followed by those of \a
+      changed, which replace the ones of \a base as a whole, and
+      freeze it. A frozen \a base is copied as a whole instead of
+      being thawed, so this is cheap when only a few translations
+      changed, e.g. when a file is reloaded. */
+  void patch(const Dictionary& base, const Dictionary& removed, const Dictionary& changed);
+
+  /** Copy all translations from \a fallback that are missing in this
+      dictionary, this resolves the fallback at load time instead of
+      on every lookup. If the Plural-Forms of the two dictionaries
+      differ, only the translations without plural forms are copied.
+      A fuzzy translation only hides the one of \a fallback while
+      fuzzy translations are enabled, so lookups give the same result
+      as with addFallback() either way. */
+  void merge_fallback(const Dictionary& fallback);
+
+  /** Iterate over all messages with a context, like foreach(), Func is of type:
       void func(const std::string& ctxt, const std::string& msgid, const std::vector<std::string>& msgstrs) */
   template<class Func>
   Func foreach_ctxt(Func func)
   {
-    for(CtxtEntries::iterator i = ctxt_entries.begin(); i != ctxt_entries.end(); ++i)
-    {
-      for(Entries::iterator j = i->second.begin(); j != i->second.end(); ++j)
+    const bool fuzzy_ok = get_use_fuzzy();
+    ctxt_entries.foreach_entry([&func, fuzzy_ok](const EntryTable::Entry& entry) {
+      const std::vector<std::string>& msgstrs = (fuzzy_ok || !entry.fuzzy) ? entry.msgstrs : entry.finished;
+      if (!msgstrs.empty() || !entry.fuzzy)
       {
-        func(i->first, j->first, j->second);
+        const std::string::size_type separator = entry.key.find(EntryTable::ctxt_separator);
+        func(entry.key.substr(0, separator), entry.key.substr(separator + 1), msgstrs);
       }
-    }
+    });
     return func;
   }
 
@@ -20,42 +20,222 @@
 #ifndef HEADER_TINYGETTEXT_DICTIONARY_MANAGER_HPP
 #define HEADER_TINYGETTEXT_DICTIONARY_MANAGER_HPP
 
+#include <atomic>
+#include <condition_variable>
 #include <deque>
+#include <exception>
+#include <functional>
+#include <future>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include "dictionary.hpp"
+#include "executor.hpp"
 #include "language.hpp"
+#include "snapshot_ptr.hpp"
+#include "translator.hpp"
 
 namespace tinygettext {
 
 class FileSystem;
+class FileWatcher;
+class POBlockIndex;
 
 /** Manager class for dictionaries, you give it a bunch of directories
     with .po files and it will then automatically load the right file
-    on demand depending on which language was set. */
+    on demand depending on which language was set.
+
+    Dictionaries can be requested from multiple threads at once, each
+    language is only loaded once and a thread only waits for the
+    language it requested. add_directory() and remove_directory() can
+    be called while other threads are using the manager, the other
+    configuration functions (set_fallback(), set_flatten_fallbacks(),
+    ...) must not. */
 class DictionaryManager
 {
+public:
+  /** Called once a dictionary loaded in the background is available,
+      the dictionary is nullptr if loading failed */
+  typedef std::function<void (const Language& language, std::shared_ptr<const Dictionary> dict)> LoadCallback;
+  typedef std::shared_future<std::shared_ptr<const Dictionary> > LoadFuture;
+
 private:
-  typedef std::unordered_map<Language, Dictionary*, Language_hash> Dictionaries;
-  Dictionaries dictionaries;
+  typedef std::unordered_map<Language, std::shared_ptr<Dictionary>, Language_hash> Dictionaries;
+
+  /** A loaded dictionary along with its view in the manager's
+      charset, so that lookups neither need the charset nor the
+      views of the dictionary */
+  struct Loaded
+  {
+    std::shared_ptr<Dictionary> dict;
+    std::shared_ptr<Dictionary> view;
+
+    /** The charset of view, as given to set_charset() */
+    std::string charset;
+  };
+  typedef std::unordered_map<Language, Loaded, Language_hash> LoadedDictionaries;
+
+  /** The loaded dictionaries, a new map is published whenever a
+      dictionary is added or the charset changes, so readers never
+      need a lock */
+  SnapshotPtr<const LoadedDictionaries> dictionaries;
+
+  /** A dictionary that is being loaded, other threads requesting the
+      same language wait for it */
+  struct Loading
+  {
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool done = false;
+    Loaded loaded;
+    std::exception_ptr error;
+  };
+  typedef std::unordered_map<Language, std::shared_ptr<Loading>, Language_hash> LoadingMap;
+
+  /** Guards loading, generation, current_language, current_owner and retired,
+      it is never held while parsing */
+  mutable std::mutex state_mutex;
+  LoadingMap loading;
+
+  /** Incremented whenever the cache is cleared, so that loads started
+      before aren't published afterwards */
+  unsigned int generation;
+
+  /** A load running on the executor */
+  struct AsyncLoad
+  {
+    std::promise<std::shared_ptr<const Dictionary> > promise;
+    LoadFuture future;
+    std::vector<LoadCallback> callbacks;
+  };
+  typedef std::unordered_map<Language, std::shared_ptr<AsyncLoad>, Language_hash> AsyncLoads;
+
+  /** Guarded by state_mutex, the destructor waits until no task is
+      left on the executor */
+  AsyncLoads async_loads;
+  unsigned int async_tasks;
+  std::condition_variable async_done;
 
+  bool async_loading;
+  std::shared_ptr<Executor> executor;
+
+  /** Replaced as a whole when a directory is added or removed, so
+      that loads can read it without taking a lock */
   typedef std::deque<std::string> SearchPath;
-  SearchPath search_path;
+  SnapshotPtr<const SearchPath> search_path;
+
+  /** Serializes the changes to the search path and keeps it from
+      changing while the watcher reloads files from it */
+  std::mutex search_path_mutex;
+
+  /** Reports changed .po files to watch_thread, which reloads the
+      languages using them once no more changes came in for
+      reload_delay milliseconds */
+  std::unique_ptr<FileWatcher> watcher;
+  std::thread watch_thread;
+  std::atomic<int> reload_delay;
+
+  /** Set while files are watched, only then the block index of the
+      loaded files is kept */
+  std::atomic<bool> watching;
+
+  /** The .po files found in a search path, so that a directory is only
+      scanned again when it has changed */
+  struct DirectoryIndex
+  {
+    /** FileSystem::get_modification_time() at the time of the scan */
+    int64_t mtime;
+
+    /** Incremented each time the directory is scanned again */
+    unsigned int generation;
+
+    /** The .po files and their languages, undefined for the ones whose
+        language isn't known */
+    std::vector<std::string> filenames;
+    std::vector<Language> languages;
+
+    /** Best matching file for each language asked for so far */
+    mutable std::mutex mutex;
+    mutable std::unordered_map<Language, std::string, Language_hash> best;
+
+    /** Return the file that matches \a language best, or an empty
+        string if none matches */
+    std::string find(const Language& language) const;
+  };
+  typedef std::unordered_map<std::string, std::shared_ptr<const DirectoryIndex> > DirectoryIndices;
+
+  /** Guards indices, which is updated when a directory changed */
+  std::mutex index_mutex;
+  DirectoryIndices indices;
+
+  /** A parsed .po file, kept so that the dictionaries it contributes
+      to can be rebuilt without parsing it again, and so that only the
+      entries that changed have to be parsed when the file changes */
+  struct Layer
+  {
+    int64_t mtime;
+    std::shared_ptr<const Dictionary> dict;
+    std::shared_ptr<const POBlockIndex> blocks;
+  };
+  typedef std::unordered_map<std::string, Layer> Layers;
+
+  std::mutex layer_mutex;
+  Layers layers;
+
+  typedef std::unordered_map<Language, Language, Language_hash> Fallbacks;
+  Fallbacks fallbacks;
 
   std::string charset;
   bool        use_fuzzy;
+  bool        use_perfect_hash;
+  bool        flatten_fallbacks;
 
   Language    current_language;
-  Dictionary* current_dict;
+  std::shared_ptr<Dictionary> current_owner;
+  std::atomic<Dictionary*> current_dict;
+
+  /** Dictionaries replaced by reload() or the watcher, get_dictionary()
+      might have handed out references to them, so they are only
+      released when the cache is cleared */
+  std::vector<std::shared_ptr<Dictionary> > retired;
 
-  Dictionary  empty_dict;
+  std::shared_ptr<Dictionary> empty_dict;
+
+  std::shared_ptr<MissTracker> miss_tracker;
 
   std::unique_ptr<FileSystem> filesystem;
 
   void clear_cache();
+  void clear_layers(const std::string& prefix = std::string());
+  Loaded get_loaded(const Language& language);
+  std::shared_ptr<Dictionary> get_shared(const Language& language);
+  void reload_languages(const std::set<Language>& changed);
+  std::shared_ptr<Dictionary> rebuild_dictionary(const Language& language, const std::set<Language>& affected,
+                                                 const LoadedDictionaries& current, Dictionaries& rebuilt);
+  std::shared_ptr<const DirectoryIndex> get_index(const std::string& pathname, bool rescan = false);
+  std::set<Language> get_affected_languages(const DirectoryIndex& index) const;
+  std::shared_ptr<const DirectoryIndex> scan_directory(const std::string& pathname, int64_t mtime,
+                                                       unsigned int index_generation);
+  std::shared_ptr<Dictionary> parse_dictionary(const Language& language);
+  void load_layer(const std::string& pofile, const Layer& old, Layer& layer);
+  std::shared_ptr<Executor> get_executor();
+  void finish_dictionary(Dictionary& dict, const std::shared_ptr<Dictionary>& fallback_dict);
+  static Loaded make_loaded(const std::shared_ptr<Dictionary>& dict, const std::string& charset);
+  void publish(const Language& language, Loaded& loaded);
+  Loaded find_loaded(const Language& language) const;
+  void run_async_load(const Language& language, const std::shared_ptr<AsyncLoad>& load);
+
+  struct Preload;
+  bool preload_step(const std::shared_ptr<Preload>& state, Executor& exec);
+  bool in_fallback_chain(const Language& language, const Language& member) const;
+
+  void watch_files();
+  void reload_files(const std::set<std::string>& files);
 
 public:
   DictionaryManager(const std::string& charset_ = "UTF-8");
@@ -63,30 +243,156 @@ public:
   ~DictionaryManager();
 
   /** Return the currently active dictionary, if none is set, an empty
-      dictionary is returned. */
+      dictionary is returned. With async loading enabled, this doesn't
+      wait for the dictionary to be loaded, but returns the closest
+      loaded fallback, or an empty dictionary, until it is ready. */
   Dictionary& get_dictionary();
 
-  /** Get dictionary for language */
+  /** Get dictionary for language. The returned reference is only
+      valid until the dictionary cache is cleared, e.g. by changing
+      the search path, use get_snapshot() to keep the dictionary
+      alive independent of the manager. Once the language is loaded,
+      this takes no lock. */
   Dictionary& get_dictionary(const Language& language);
 
-  /** Set a language based on a four? letter country code */
+  /** Return the dictionary for \a language, or for the current
+      language, as a shared snapshot. The snapshot stays valid and
+      unchanged, even when the manager reloads its dictionaries in the
+      meantime. */
+  std::shared_ptr<const Dictionary> get_snapshot(const Language& language);
+  std::shared_ptr<const Dictionary> get_snapshot();
+
+  /** Return the dictionary for \a language in \a charset instead of
+      the manager's charset, the language is only loaded once no
+      matter in how many charsets it is requested */
+  std::shared_ptr<const Dictionary> get_snapshot(const Language& language, const std::string& charset);
+
+  /** Return a Translator for \a language, or for the current
+      language. Unlike get_dictionary(), this doesn't depend on the
+      manager's current language, so concurrent requests in different
+      languages can each carry their own Translator. */
+  Translator get_translator(const Language& language);
+  Translator get_translator(const Language& language, const std::string& charset);
+  Translator get_translator();
+
+  /** Scan the directories and parse all loaded languages again and
+      publish the new dictionaries at once, snapshots of the old ones
+      remain valid. References returned by get_dictionary() stay
+      valid as well, the old dictionaries are kept until the cache is
+      cleared. */
+  void reload();
+
+  /** Set a language based on a four? letter country code, with async
+      loading enabled this starts loading it in the background */
   void set_language(const Language& language);
 
+  /** Load the dictionary for \a language in the background, \a
+      callback is called (from the loading thread) once it is
+      available to get_dictionary(). If it is already loaded, \a
+      callback is called right away. Calling this again while the
+      language is still loading doesn't start a second load. */
+  LoadFuture load_async(const Language& language, LoadCallback callback = LoadCallback());
+
+  /** Load all of \a languages, in parallel on \a executor, and wait
+      until they are loaded. A language is only started once its
+      fallback is loaded, e.g. de before de_AT. The calling thread
+      takes part in the loading, so this can be called from a task
+      running on \a executor itself. Without an executor, a temporary
+      ThreadPool with one thread per core is used. */
+  void preload(const std::set<Language>& languages);
+  void preload(const std::set<Language>& languages, Executor& executor);
+
+  /** Let get_dictionary() return immediately, instead of loading the
+      current language on the calling thread */
+  void set_async_loading(bool t);
+  bool get_async_loading() const;
+
+  /** Set the executor used for background loading and for parsing
+      the .po files of multiple search paths in parallel, by default a
+      ThreadPool with one thread per core is created on first use. The
+      destructor waits for all tasks handed to the executor, so it
+      must outlive the manager or keep running them. */
+  void set_executor(std::shared_ptr<Executor> executor);
+
   /** returns the (normalized) country code of the currently used language */
   Language get_language() const;
 
+  /** Use translations marked as fuzzy (the default), fuzzy
+      translations are always loaded, so this takes effect
+      immediately and doesn't reload anything */
   void set_use_fuzzy(bool t);
   bool get_use_fuzzy() const;
 
-  /** Set a charset that will be set on the returned dictionaries */
+  /** Build a minimal perfect hash function for dictionaries loaded
+      from now on, this costs some time when loading, but makes the
+      lookups cheaper */
+  void set_use_perfect_hash(bool t);
+  bool get_use_perfect_hash() const;
+
+  /** Watch the search path for .po files that are modified, added
+      or removed and reload the languages using them in the
+      background, each reloaded language is published at once, like
+      with reload(). This needs a FileSystem that supports
+      watching, UnixFileSystem does on Linux. Files loaded while
+      watching is enabled are indexed, so that a change to them only
+      parses the entries that changed. As with reload(), the replaced
+      dictionaries are kept for get_dictionary() references until the
+      cache is cleared, e.g. by changing the search path or the
+      fallbacks, so memory grows with each change until then. */
+  void set_watch_files(bool t);
+  bool get_watch_files() const;
+
+  /** Wait until no file changed for \a milliseconds before
+      reloading, so that saving many files at once reloads each
+      language only once, the default is 200 */
+  void set_reload_delay(int milliseconds);
+  int get_reload_delay() const;
+
+  /** Set the language to fall back to when a translation is missing
+      in \a language, the fallback can have a fallback of its own,
+      e.g. pt_BR -> pt -> es. An undefined Language disables the
+      fallback. By default a language with a country falls back to
+      the language without one, e.g. de_AT -> de. */
+  void set_fallback(const Language& language, const Language& fallback);
+  Language get_fallback(const Language& language) const;
+
+  /** Merge the translations of the fallback chain into each
+      dictionary when it is loaded, so that lookups need no more than
+      a single hash lookup regardless of the depth of the chain */
+  void set_flatten_fallbacks(bool t);
+  bool get_flatten_fallbacks() const;
+
+  /** Return the tracker that collects the misses of all
+      dictionaries of this manager, so they can be inspected or
+      written out as .pot file */
+  std::shared_ptr<MissTracker> get_miss_tracker() const;
+
+  /** Replace the tracker used by the dictionaries, pass nullptr to
+      log each miss instead. This clears the dictionary cache. */
+  void set_miss_tracker(std::shared_ptr<MissTracker> tracker);
+
+  /** Set a charset that will be set on the returned dictionaries,
+      the dictionaries are loaded as UTF-8 and the ones already
+      loaded are converted here, so this doesn't parse anything
+      again. If the conversion isn't available, a warning is logged
+      and the dictionaries stay in UTF-8. The dictionaries passed
+      to load_async() callbacks and futures are always UTF-8, use
+      Dictionary::get_view() to convert them. */
   void set_charset(const std::string& charset);
+  std::string get_charset() const;
 
   /** Add a directory to the search path for dictionaries, earlier
       added directories have higher priority then later added ones.
-      Set @p precedence to true to invert this for a single addition. */
+      Set @p precedence to true to invert this for a single addition.
+      The directory is scanned once here, and only scanned again when
+      the FileSystem reports it as modified. Only the loaded languages
+      that have a .po file in the directory (and the ones falling back
+      to them) are reloaded, the .po files of the other directories
+      aren't parsed again. */
   void add_directory(const std::string& pathname, bool precedence = false);
 
-  /** Remove a directory from the search path */
+  /** Remove a directory from the search path, this reloads the same
+      languages as add_directory() */
   void remove_directory(const std::string& pathname);
 
   /** Return a set of the available languages in their country code */
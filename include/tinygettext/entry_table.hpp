@@ -0,0 +1,272 @@
+// tinygettext - A gettext replacement that works directly on .po files
+// Copyright (c) 2006 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgement in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#ifndef HEADER_TINYGETTEXT_ENTRY_TABLE_HPP
+#define HEADER_TINYGETTEXT_ENTRY_TABLE_HPP
+
+#include <functional>
+#include <optional>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tinygettext {
+
+/** Hash table mapping a msgid to its msgstrs, used as storage by the
+    Dictionary. The table uses open addressing with linear probing
+    over a contiguous array of slots. A slot only holds the hash of
+    its key and the index of the entry, so a lookup usually touches a
+    single cache line of the slot array before comparing the key. The
+    entries themselves are stored out of line in insertion order.
+
+    Once all entries are added, freeze() moves all strings into a
+    single arena and releases the per-entry allocations. Adding an
+    entry to a frozen table transparently thaws it again.
+
+    A frozen table can optionally replace its slots with a minimal
+    perfect hash function, the entries are then stored in hash
+    order, so that a lookup is a single hash, an index computation
+    and a single key comparison.
+
+    Entries with a context are keyed by msgctxt and msgid joined with
+    ctxt_separator, the same convention as used by .mo files. Lookups
+    hash and compare the two parts in place, so they need neither a
+    temporary string nor a second hash computation. */
+class EntryTable
+{
+public:
+  struct Entry
+  {
+    /** msgid, or msgctxt and msgid joined by ctxt_separator */
+    std::string key;
+    std::vector<std::string> msgstrs;
+
+    /** The translation was marked as fuzzy in the .po file */
+    bool fuzzy = false;
+
+    /** The translation a fuzzy one replaced, if it wasn't fuzzy
+        itself, it is used while fuzzy translations are disabled */
+    std::vector<std::string> finished;
+  };
+
+  static constexpr char ctxt_separator = '\x04';
+
+  /** View on the msgstrs of an entry, valid until the table is
+      modified or destroyed */
+  class Msgstrs
+  {
+  private:
+    const std::vector<std::string>* strings;
+    const std::vector<std::string>* finished_strings;
+    const char* arena;
+    const uint32_t* offsets;
+    size_t count;
+    size_t finished_count;
+    bool fuzzy;
+
+  public:
+    Msgstrs(const std::vector<std::string>& strings_, bool fuzzy_ = false,
+            const std::vector<std::string>* finished_ = nullptr) :
+      strings(&strings_), finished_strings(finished_), arena(), offsets(),
+      count(strings_.size()), finished_count(finished_ ? finished_->size() : 0), fuzzy(fuzzy_)
+    {}
+
+    /** The finished msgstrs, if any, follow the \a count msgstrs */
+    Msgstrs(const char* arena_, const uint32_t* offsets_, size_t count_, bool fuzzy_ = false,
+            size_t finished_count_ = 0) :
+      strings(), finished_strings(), arena(arena_), offsets(offsets_),
+      count(count_), finished_count(finished_count_), fuzzy(fuzzy_)
+    {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool is_fuzzy() const { return fuzzy; }
+
+    /** The translation kept behind a fuzzy one, see Entry::finished */
+    Msgstrs finished() const
+    {
+      if (finished_strings)
+        return Msgstrs(*finished_strings);
+      else if (strings)
+        return Msgstrs(nullptr, nullptr, 0);
+      else
+        return Msgstrs(arena, offsets + count, finished_count);
+    }
+
+    std::string_view operator[](size_t n) const
+    {
+      if (strings)
+        return (*strings)[n];
+      else
+        return std::string_view(arena + offsets[n], offsets[n + 1] - offsets[n]);
+    }
+  };
+
+private:
+  /** Key of an entry, a msgid optionally with a msgctxt */
+  struct Key
+  {
+    std::string_view msgctxt;
+    std::string_view msgid;
+    bool has_ctxt;
+
+    uint64_t hash() const;
+    bool operator==(std::string_view key) const;
+  };
+
+  static uint64_t hash(uint64_t h, std::string_view text);
+  static uint64_t hash(std::string_view text);
+
+  struct Slot
+  {
+    uint32_t hash;
+    uint32_t index;
+  };
+
+  static constexpr uint32_t empty_slot = 0xffffffff;
+
+  std::vector<Slot> slots;
+  std::vector<Entry> entries;
+
+  /** Frozen storage: string i is arena[offsets[i], offsets[i+1]),
+      entry i consists of the strings [first[i], first[i+1]), the
+      first of which is the msgid, the remaining ones the msgstrs. */
+  bool frozen;
+  std::string arena;
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> first;
+
+  /** Frozen fuzzy flags: entry i is fuzzy if fuzzy[i] isn't zero,
+      it then has fuzzy[i] - 1 msgstrs, its remaining strings are the
+      finished translation kept behind them. Empty when the table has
+      no fuzzy entries at all. */
+  std::vector<uint32_t> fuzzy;
+
+  /** Perfect hash: the bucket of a key selects a pilot value, which
+      together with the hash of the key gives its position in a
+      table slightly larger than the number of entries. Positions
+      past the last entry are mapped back onto the free positions
+      through remap. */
+  uint64_t mph_seed;
+  uint64_t mph_size;
+  std::vector<uint32_t> pilots;
+  std::vector<uint32_t> remap;
+
+  void grow();
+  void thaw();
+  void rebuild_slots();
+  bool build_perfect_hash(std::vector<uint32_t>& order);
+  size_t perfect_hash_position(uint64_t h) const;
+
+  uint32_t find_index(const Key& key, uint32_t h) const;
+  uint32_t find_index(const Key& key) const;
+  std::optional<Msgstrs> find(const Key& key) const;
+  Entry& get(const Key& key);
+  bool erase(const Key& key);
+  std::string_view get_string(uint32_t i) const
+  {
+    return std::string_view(arena.data() + offsets[i], offsets[i + 1] - offsets[i]);
+  }
+
+  /** Copy frozen entry \a i out of the arena */
+  Entry get_entry(size_t i) const;
+
+  /** Append \a entry to the arena of a table that is being frozen */
+  void append_frozen(const Entry& entry, bool has_fuzzy);
+
+public:
+  EntryTable();
+
+  /** Returns the msgstrs for \a msgid or nothing if there are none */
+  std::optional<Msgstrs> find(std::string_view msgid) const;
+  std::optional<Msgstrs> find(std::string_view msgctxt, std::string_view msgid) const;
+
+  /** Returns the entry for \a msgid, creating an empty one if it
+      doesn't exist yet. This invalidates any view previously
+      returned. */
+  Entry& get(std::string_view msgid);
+  Entry& get(std::string_view msgctxt, std::string_view msgid);
+
+  /** Removes the entry for \a msgid, returns false if there is
+      none. This invalidates any view previously returned. */
+  bool erase(std::string_view msgid);
+  bool erase(std::string_view msgctxt, std::string_view msgid);
+
+  /** Moves all entries of \a other into this table, leaving \a
+      other empty. For keys present in both tables \a merge_entry is
+      called with the existing entry and the one from \a other
+      instead, along with the position of the latter in \a other,
+      which counts the entries in the order they were added as long
+      as none was erased. This neither copies strings nor rehashes the
+      entries already in this table. */
+  void merge(EntryTable&& other,
+             const std::function<void (Entry& entry, Entry& other_entry, size_t other_index)>& merge_entry);
+
+  /** Replaces the contents of this table with the entries of \a base,
+      except those with a key in \a removed or \a added, followed by
+      the entries of \a added, and freezes it. A frozen \a base isn't
+      thawed, runs of entries are copied out of its arena as a whole
+      and its slots are reused, so when only a few entries change this
+      costs little more than copying \a base. */
+  void assign_patched(const EntryTable& base, const EntryTable& removed, const EntryTable& added);
+
+  /** Compacts the table into a read-only layout, if \a perfect_hash
+      is set lookups will use a minimal perfect hash function instead
+      of the slot array */
+  void freeze(bool perfect_hash = false);
+  bool is_frozen() const { return frozen; }
+  bool has_perfect_hash() const { return !pilots.empty(); }
+
+  size_t size() const { return frozen ? first.size() - 1 : entries.size(); }
+  bool empty() const { return size() == 0; }
+
+  /** Iterate over all entries, Func is of type:
+      void func(const Entry& entry) */
+  template<class Func>
+  void foreach_entry(Func func) const
+  {
+    if (!frozen)
+    {
+      for(std::vector<Entry>::const_iterator i = entries.begin(); i != entries.end(); ++i)
+        func(*i);
+    }
+    else
+    {
+      for(size_t i = 0; i + 1 < first.size(); ++i)
+        func(get_entry(i));
+    }
+  }
+
+  /** Iterate over all entries, Func is of type:
+      void func(const std::string& key, const std::vector<std::string>& msgstrs) */
+  template<class Func>
+  void foreach(Func func) const
+  {
+    foreach_entry([&func](const Entry& entry) {
+      func(entry.key, entry.msgstrs);
+    });
+  }
+};
+
+} // namespace tinygettext
+
+#endif
+
+/* EOF */
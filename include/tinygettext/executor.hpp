@@ -0,0 +1,102 @@
+// tinygettext - A gettext replacement that works directly on .po files
+// Copyright (c) 2009 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgement in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+
+#ifndef HEADER_TINYGETTEXT_EXECUTOR_HPP
+#define HEADER_TINYGETTEXT_EXECUTOR_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tinygettext {
+
+/** Runs the background work of the DictionaryManager, implement this
+    to hand the work to an existing job system */
+class Executor
+{
+public:
+  virtual ~Executor() {}
+
+  /** Run \a task at some point, on any thread */
+  virtual void execute(std::function<void ()> task) =0;
+};
+
+/** Executor that runs tasks on a fixed number of std::threads. Each
+    thread has its own queue, tasks submitted from a pool thread go to
+    the queue of that thread, others are distributed round-robin. A
+    thread takes the newest task from its own queue and when that is
+    empty, steals the oldest one from another thread. */
+class ThreadPool : public Executor
+{
+private:
+  struct Worker
+  {
+    std::mutex mutex;
+    std::deque<std::function<void ()> > tasks;
+  };
+
+  std::vector<std::unique_ptr<Worker> > workers;
+  std::atomic<size_t> next_worker;
+
+  /** Guards pending and stopping, idle threads sleep on cond */
+  std::mutex mutex;
+  std::condition_variable cond;
+  size_t pending;
+  bool stopping;
+
+  std::vector<std::thread> threads;
+
+  bool pop(size_t index, std::function<void ()>& task);
+  void run(size_t index);
+
+public:
+  /** Start \a num_threads threads, zero means one per hardware thread */
+  ThreadPool(unsigned int num_threads = 0);
+
+  /** Waits for all queued tasks to finish */
+  ~ThreadPool() override;
+
+  void execute(std::function<void ()> task) override;
+
+  size_t size() const { return threads.size(); }
+
+private:
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+};
+
+/** Call \a func for each index in [0, count) using \a executor and
+    return once all calls finished. The calling thread runs every call
+    that no executor thread has picked up yet, so this doesn't depend
+    on the executor having a free thread and can be called from a task
+    of \a executor itself. An exception thrown by \a func is passed on
+    to the caller. */
+void parallel_for(Executor& executor, size_t count, const std::function<void (size_t)>& func);
+
+} // namespace tinygettext
+
+#endif
+
+/* EOF */
@@ -23,8 +23,11 @@
 #include <vector>
 #include <memory>
 #include <iosfwd>
+#include <stdint.h>
 #include <string>
 
+#include "file_watcher.hpp"
+
 namespace tinygettext {
 
 class FileSystem
@@ -34,6 +37,16 @@ public:
 
   virtual std::vector<std::string>      open_directory(const std::string& pathname) =0;
   virtual std::unique_ptr<std::istream> open_file(const std::string& filename)      =0;
+
+  /** Return a value that changes whenever the directory or file at
+      \a pathname is modified, or 0 if that isn't known. This is used
+      to notice when a directory has to be scanned or a file parsed
+      again, with 0 that's done every time. */
+  virtual int64_t get_modification_time(const std::string& /*pathname*/) { return 0; }
+
+  /** Return a watcher that reports changes to the files of this
+      FileSystem, or nullptr if changes can't be watched */
+  virtual std::unique_ptr<FileWatcher> create_watcher() { return std::unique_ptr<FileWatcher>(); }
 };
 
 } // namespace tinygettext
@@ -0,0 +1,56 @@
+// tinygettext - A gettext replacement that works directly on .po files
+// Copyright (c) 2009 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgement in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#ifndef HEADER_TINYGETTEXT_FILE_WATCHER_HPP
+#define HEADER_TINYGETTEXT_FILE_WATCHER_HPP
+
+#include <string>
+#include <vector>
+
+namespace tinygettext {
+
+/** Reports files that were modified, created or removed in a set of
+    directories, see FileSystem::create_watcher(). add_directory(),
+    remove_directory() and stop() can be called while another thread
+    is blocked in wait(). */
+class FileWatcher
+{
+public:
+  virtual ~FileWatcher() {}
+
+  virtual void add_directory(const std::string& pathname) =0;
+  virtual void remove_directory(const std::string& pathname) =0;
+
+  /** Wait up to \a timeout_ms milliseconds for changes and append the
+      paths of the changed files to \a changed, a negative \a
+      timeout_ms waits until something changes. \a overflow is set
+      when changes were lost, e.g. because too many came in at once,
+      then any file might have changed. Returns false once stop() was
+      called. */
+  virtual bool wait(int timeout_ms, std::vector<std::string>& changed, bool& overflow) =0;
+
+  /** Make wait() return false, now and from then on */
+  virtual void stop() =0;
+};
+
+} // namespace tinygettext
+
+#endif
+
+/* EOF */
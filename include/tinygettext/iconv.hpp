@@ -90,6 +90,10 @@ public:
   void set_charsets(const std::string& fromcode, const std::string& tocode);
   std::string convert(const std::string& text);
 
+  /** Returns true when both charsets are the same, in which case
+      convert() returns the text unchanged */
+  bool is_identity() const { return !cd; }
+
 private:
   IConv (const IConv&);
   IConv& operator= (const IConv&);
@@ -0,0 +1,90 @@
+// tinygettext - A gettext replacement that works directly on .po files
+// Copyright (c) 2009 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgement in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#ifndef HEADER_TINYGETTEXT_MISS_TRACKER_HPP
+#define HEADER_TINYGETTEXT_MISS_TRACKER_HPP
+
+#include <chrono>
+#include <iosfwd>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace tinygettext {
+
+/** Collects the messages for which no translation was found. Each
+    distinct message is stored only once, together with the number of
+    times it was missed and the time it was first missed, so a miss
+    costs a single hash lookup instead of a log message. The collected
+    messages can be written out as a .pot fragment. MissTracker can be
+    used from multiple threads at once. */
+class MissTracker
+{
+public:
+  struct Miss
+  {
+    bool has_msgctxt;
+    std::string msgctxt;
+    std::string msgid;
+    std::string msgid_plural;
+    unsigned long count;
+    std::chrono::system_clock::time_point first_seen;
+  };
+
+private:
+  struct Shard
+  {
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Miss> misses;
+  };
+
+  static constexpr size_t shard_count = 16;
+  Shard shards[shard_count];
+
+public:
+  MissTracker();
+
+  /** Record a miss of \a msgid, in context \a msgctxt if one is
+      given, an empty \a msgid_plural stands for a message without
+      plural forms */
+  void record(std::optional<std::string_view> msgctxt,
+              std::string_view msgid, std::string_view msgid_plural);
+
+  /** Return all misses ordered by the time they were first seen */
+  std::vector<Miss> get_misses() const;
+
+  size_t size() const;
+  void clear();
+
+  /** Write all misses as .pot entries to \a out */
+  void write_pot(std::ostream& out) const;
+
+private:
+  MissTracker(const MissTracker&) = delete;
+  MissTracker& operator=(const MissTracker&) = delete;
+};
+
+} // namespace tinygettext
+
+#endif
+
+/* EOF */
@@ -0,0 +1,106 @@
+// tinygettext - A gettext replacement that works directly on .po files
+// Copyright (c) 2009 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgement in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#ifndef HEADER_TINYGETTEXT_PO_BLOCK_INDEX_HPP
+#define HEADER_TINYGETTEXT_PO_BLOCK_INDEX_HPP
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace tinygettext {
+
+/** Index over the entries of a .po file, used to find out which
+    entries changed between two versions of the file without parsing
+    either of them completely. The text is split into blocks of one
+    entry each, every block is hashed and keyed by the msgctxt and
+    msgid lines of its entry, exactly as they appear in the file. */
+class POBlockIndex
+{
+public:
+  struct Diff
+  {
+    /** The header and all added or modified entries, as .po text */
+    std::string changed;
+
+    /** The header and the msgctxt and msgid of all removed or
+        modified entries, as .po text with a dummy msgstr */
+    std::string removed;
+
+    /** The line each block of changed starts at, in changed and in
+        the file, in the order of changed */
+    std::vector<std::pair<int, int> > changed_lines;
+
+    /** Map line \a line of changed to the line of the file it was
+        taken from, for diagnostics */
+    int file_line(int line) const;
+  };
+
+private:
+  struct Block
+  {
+    uint64_t key_hash;
+    uint64_t hash;
+
+    /** Position in the text the index was built from */
+    size_t offset;
+    size_t length;
+    int line;
+
+    /** Position of the msgctxt and msgid lines in keys */
+    size_t key_offset;
+    size_t key_length;
+  };
+
+  bool has_header;
+  Block header;
+
+  /** Sorted by key_hash, so that two indices can be compared in a
+      single pass */
+  std::vector<Block> blocks;
+  std::string keys;
+
+  std::string_view get_key(const Block& block) const
+  {
+    return std::string_view(keys).substr(block.key_offset, block.key_length);
+  }
+
+public:
+  POBlockIndex();
+
+  /** Index \a text, returns false if it can't be indexed, e.g.
+      because it contains the same entry twice */
+  bool build(std::string_view text);
+
+  /** Collect the entries that differ between \a old and this index,
+      \a text has to be the text this index was built from. Returns
+      false if the header changed, the file then has to be parsed
+      again as a whole. */
+  bool diff(const POBlockIndex& old, std::string_view text, Diff& result) const;
+
+  size_t size() const { return blocks.size(); }
+};
+
+} // namespace tinygettext
+
+#endif
+
+/* EOF */
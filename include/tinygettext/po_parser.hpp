@@ -21,18 +21,65 @@
 #define HEADER_TINYGETTEXT_PO_PARSER_HPP
 
 #include <iosfwd>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "iconv.hpp"
+#include "po_scanner.hpp"
 
 namespace tinygettext {
 
 class Dictionary;
+class Executor;
+
+/** A warning or error found while parsing a PO file */
+struct PODiagnostic
+{
+  enum Code
+  {
+    // warnings
+    UNKNOWN_ESCAPE,
+    GARBAGE_AFTER_STRING,
+    KEYWORD_SPACING,
+    LEADING_WHITESPACE,
+    MALFORMED_CONTENT_TYPE,
+    UNKNOWN_PLURAL_FORMS,
+    PLURAL_FORMS_MISMATCH,
+    MISSING_CHARSET,
+    MISSING_PLURAL_FORMS,
+    PLURAL_COUNT_MISMATCH,
+    DUPLICATE_ENTRY,
+
+    // errors, the entry they occur in is skipped
+    UNEXPECTED_END_OF_LINE,
+    EXPECTED_STRING,
+    UNEXPECTED_END_OF_STRING,
+    INVALID_BIG5,
+    EXPECTED_MSGID,
+    EXPECTED_MSGSTR,
+    EXPECTED_EMPTY_LINE
+  };
+
+  std::string filename;
+  int line_number;
+  Code code;
+  bool error;
+  std::string message;
+
+  /** The line the problem was found in */
+  std::string line;
+};
 
 class POParser
 {
 private:
   std::string filename;
-  std::istream& in;
+  std::string_view data;
+  std::string_view::size_type pos;
   Dictionary& dict;
   bool  use_fuzzy;
 
@@ -41,34 +88,167 @@ private:
   bool big5;
 
   int line_number;
-  std::string current_line;
+  std::string_view current_line;
+
+  /** Set once the header entry was parsed, header_charset is the
+      charset it specified */
+  bool has_header;
+  std::string header_charset;
+
+  /** Set when the recovery from an error reached the end of the
+      data, the entry after it would have been skipped as well */
+  bool eof_in_recovery;
+
+  /** Set by error(), the rest of the entry is skipped */
+  bool failed;
+
+  /** Where warnings and errors go, they are logged if this is null */
+  std::vector<PODiagnostic>* diagnostics;
 
   IConv conv;
+  POScanner scanner;
 
-  POParser(const std::string& filename, std::istream& in_, Dictionary& dict_, bool use_fuzzy = true);
-  ~POParser();
+  /** Scratch space for strings that can't be sliced out of the
+      buffer, as they contain escapes, span multiple lines or need
+      charset conversion */
+  std::string msgctxt_buffer;
+  std::string msgid_buffer;
+  std::string msgid_plural_buffer;
+  std::string msgstr_buffer;
+  std::string convert_buffer;
+  std::vector<std::string> msgstrs_buffer;
+
+  /** Set while parsing a chunk of the parallel parse(): where each
+      entry first occurred, in the order the entries were added to
+      the chunk's dictionary, separately for the ones without and
+      with context, the first translation of the entries that
+      occurred again within the chunk and those that did so with
+      plural forms, by their joined key. This lets parse() report a
+      duplicate across chunks where a sequential parse would have. */
+  struct EntrySource
+  {
+    int line;
+    std::string_view text;
+
+    /** Number of diagnostics reported before it */
+    size_t diagnostic;
 
-  void parse_header(const std::string& header);
+    /** Whether it has no plural forms */
+    bool singular;
+  };
+  bool track_sources;
+  std::vector<EntrySource> entry_sources[2];
+  std::unordered_map<std::string, std::vector<std::string> > first_msgstrs;
+  std::unordered_set<std::string> plural_duplicates;
+
+  /** State of feed(): the data that wasn't parsed yet, as it doesn't
+      end with a complete blank line, the number of lines before it,
+      and the scan position within the last, incomplete line */
+  std::string pending;
+  int pending_first_line;
+  int pending_lines;
+  std::string::size_type pending_line_start;
+  bool pending_line_blank;
+  bool started;
+
+  POParser(const std::string& filename, std::string_view data_, Dictionary& dict_, bool use_fuzzy = true);
+
+  void parse_header(std::string_view header);
   void parse();
+  void parse_chunk(bool recovering);
+  void parse_entries();
+  void parse_entry();
+  void recover();
+  void parse_pending(std::string_view block);
   void next_line();
-  std::string get_string(unsigned int skip);
-  void get_string_line(std::ostringstream& str, size_t skip);
+  std::string_view get_string(unsigned int skip, std::string& buffer);
+  std::string_view get_string_line(size_t skip, bool& escaped);
+  void unescape(std::string_view str, std::string& out) const;
+  std::string_view convert(std::string_view str);
   bool is_empty_line();
   bool prefix(const char* );
-#ifdef _WIN32
-  void error(const std::string& msg);
-#else
-  void error(const std::string& msg) __attribute__((__noreturn__));
-#endif
-  void warning(const std::string& msg);
+  void error(PODiagnostic::Code code, const std::string& msg);
+  void warning(PODiagnostic::Code code, const std::string& msg);
+  void report(PODiagnostic::Code code, bool error, const std::string& msg);
+  void report(PODiagnostic::Code code, bool error, const std::string& msg,
+              int at_line, std::string_view at_text);
+
+  /** Add the translation of an entry to the dictionary, a different
+      translation it replaces is reported at \a msgid_line. \a singular
+      is set for an entry without plural forms. */
+  void add_translation(std::optional<std::string_view> msgctxt, std::string_view msgid,
+                       std::vector<std::string>& msgstrs, bool singular, bool fuzzy,
+                       int msgid_line, std::string_view msgid_text);
 
 public:
+  /** Creates a parser that is handed the PO file piece by piece
+      with feed(), so that reading the next piece can overlap with
+      parsing the previous one
+      @param filename name of the file, only used in error messages
+      @param dict dictionary to which the strings are written
+      @param diagnostics if given, warnings and errors are appended
+      to it instead of being logged */
+  POParser(const std::string& filename, Dictionary& dict,
+           std::vector<PODiagnostic>* diagnostics = nullptr);
+  ~POParser();
+
+  /** Parses the next piece of the PO file, pieces may end anywhere,
+      even within a string or an escape sequence. Entries are only
+      parsed once the blank line after them was seen, the rest is
+      kept until the next call. */
+  void feed(std::string_view bytes);
+
+  /** Parses what is left after the last call to feed(), the parser
+      can't be fed any more afterwards */
+  void finish();
+
   /** @param filename name of the istream, only used in error messages
       @param in stream from which the PO file is read.
-      @param dict dictionary to which the strings are written */
-  static void parse(const std::string& filename, std::istream& in, Dictionary& dict);
+      @param dict dictionary to which the strings are written
+      @param diagnostics if given, warnings and errors are appended
+      to it instead of being logged */
+  static void parse(const std::string& filename, std::istream& in, Dictionary& dict,
+                    std::vector<PODiagnostic>* diagnostics = nullptr);
+
+  /** Parses a PO file held completely in memory, e.g. a mmap'ed
+      file. Strings without escapes are passed to the dictionary
+      straight out of \a data, which only has to stay valid for the
+      duration of the call.
+      @param filename name of the buffer, only used in error messages
+      @param data contents of the PO file
+      @param dict dictionary to which the strings are written
+      @param diagnostics see above */
+  static void parse(const std::string& filename, std::string_view data, Dictionary& dict,
+                    std::vector<PODiagnostic>* diagnostics = nullptr);
+
+  /** Like parse() above, but splits \a data at blank lines between
+      entries into \a num_chunks pieces and parses them in parallel
+      on \a executor, after the header was parsed on the calling
+      thread. The result, including which translation wins when an
+      entry appears twice, is the same as that of a sequential parse
+      and the diagnostics are reported in order and with the
+      right line numbers.
+      @param num_chunks number of pieces, zero picks one based on the
+      size of \a data and the number of hardware threads
+      @param diagnostics see above */
+  static void parse(const std::string& filename, std::string_view data, Dictionary& dict,
+                    Executor& executor, size_t num_chunks = 0,
+                    std::vector<PODiagnostic>* diagnostics = nullptr);
+
+  /** Writes \a diagnostic to the log, in the same format parse()
+      uses when it isn't given a vector to collect them in */
+  static void log(const PODiagnostic& diagnostic);
+
+  /** Size of the pieces parse() splits data into at least */
+  static const size_t min_chunk_size;
+
   static bool pedantic;
 
+  /** Name of the POScanner implementation the parsers use, empty (the
+      default) picks the one for the CPU. Meant for comparing them,
+      set it before parsing. */
+  static std::string scanner_implementation;
+
 private:
   POParser (const POParser&);
   POParser& operator= (const POParser&);
@@ -0,0 +1,76 @@
+// tinygettext - A gettext replacement that works directly on .po files
+// Copyright (c) 2009 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgement in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#ifndef HEADER_TINYGETTEXT_PO_SCANNER_HPP
+#define HEADER_TINYGETTEXT_PO_SCANNER_HPP
+
+#include <string>
+
+namespace tinygettext {
+
+/** Byte scanning used by POParser. The searches look at 32 or 16
+    bytes at a time with AVX2 or SSE2, whichever the CPU supports,
+    and fall back to plain loops on other platforms. They return \a
+    end when nothing is found and never read past it. */
+class POScanner
+{
+private:
+  const char* name;
+  const char* (*find_string_special_fn)(const char* begin, const char* end, bool high_bytes);
+  const char* (*find_newline_fn)(const char* begin, const char* end);
+  const char* (*skip_space_fn)(const char* begin, const char* end);
+
+public:
+  /** Picks the implementation for the CPU the program runs on */
+  POScanner();
+
+  /** Use the implementation called \a implementation instead, e.g. to
+      compare them. If the CPU doesn't support it, the default one is
+      used, get_implementation() tells which one it is. */
+  explicit POScanner(const std::string& implementation);
+
+  /** Returns the first '"' or '\\' in [begin, end), with \a
+      high_bytes also the first byte >= 0x80, e.g. a Big5 lead byte */
+  const char* find_string_special(const char* begin, const char* end, bool high_bytes) const
+  {
+    return find_string_special_fn(begin, end, high_bytes);
+  }
+
+  /** Returns the first '\\n' in [begin, end) */
+  const char* find_newline(const char* begin, const char* end) const
+  {
+    return find_newline_fn(begin, end);
+  }
+
+  /** Returns the first byte in [begin, end) that isn't whitespace in
+      the "C" locale */
+  const char* skip_space(const char* begin, const char* end) const
+  {
+    return skip_space_fn(begin, end);
+  }
+
+  /** Name of the implementation in use: "avx2", "sse2" or "generic" */
+  const char* get_implementation() const { return name; }
+};
+
+} // namespace tinygettext
+
+#endif
+
+/* EOF */
@@ -0,0 +1,113 @@
+// tinygettext - A gettext replacement that works directly on .po files
+// Copyright (c) 2009 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgement in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#ifndef HEADER_TINYGETTEXT_SNAPSHOT_PTR_HPP
+#define HEADER_TINYGETTEXT_SNAPSHOT_PTR_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace tinygettext {
+
+/** A std::shared_ptr that can be replaced while other threads read
+    it, in the style of RCU. load() never takes a lock, it only
+    registers itself in one of two reader counters while it copies
+    the current pointer. store() publishes the new pointer with a
+    single atomic swap and then waits for the readers that might
+    still see the old one before releasing it (a grace period), so
+    the old value lives on exactly as long as someone holds a copy of
+    it. Writers are serialized among themselves. */
+template<class T>
+class SnapshotPtr
+{
+private:
+  std::atomic<std::shared_ptr<T>*> current;
+
+  /** Readers register in readers[phase % 2], a writer flips the phase
+      and waits for the readers of the previous phase to finish */
+  std::atomic<unsigned int> phase;
+  mutable std::atomic<unsigned int> readers[2];
+
+  std::mutex writer_mutex;
+
+public:
+  SnapshotPtr(std::shared_ptr<T> value = std::shared_ptr<T>()) :
+    current(new std::shared_ptr<T>(std::move(value))),
+    phase(0),
+    readers(),
+    writer_mutex()
+  {
+    readers[0] = 0;
+    readers[1] = 0;
+  }
+
+  ~SnapshotPtr()
+  {
+    delete current.load();
+  }
+
+  /** Return the current value, never blocks */
+  std::shared_ptr<T> load() const
+  {
+    for(;;)
+    {
+      const unsigned int p = phase.load();
+      readers[p % 2].fetch_add(1);
+      // a writer that flipped the phase in the meantime won't wait
+      // for us, so we must not touch the pointer
+      if (phase.load() == p)
+      {
+        std::shared_ptr<T> result = *current.load();
+        readers[p % 2].fetch_sub(1);
+        return result;
+      }
+      readers[p % 2].fetch_sub(1);
+    }
+  }
+
+  /** Publish \a value, the previous value is released once no reader
+      can access it anymore */
+  void store(std::shared_ptr<T> value)
+  {
+    std::lock_guard<std::mutex> lock(writer_mutex);
+
+    std::shared_ptr<T>* old = current.exchange(new std::shared_ptr<T>(std::move(value)));
+
+    const unsigned int p = phase.load();
+    phase.store(p + 1);
+    while(readers[p % 2].load() != 0)
+    {
+      std::this_thread::yield();
+    }
+
+    delete old;
+  }
+
+private:
+  SnapshotPtr(const SnapshotPtr&) = delete;
+  SnapshotPtr& operator=(const SnapshotPtr&) = delete;
+};
+
+} // namespace tinygettext
+
+#endif
+
+/* EOF */
@@ -23,6 +23,7 @@
 #include "dictionary.hpp"
 #include "dictionary_manager.hpp"
 #include "language.hpp"
+#include "translator.hpp"
 
 #endif
 
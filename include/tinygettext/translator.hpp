@@ -0,0 +1,76 @@
+// tinygettext - A gettext replacement that works directly on .po files
+// Copyright (c) 2006 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgement in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+
+#ifndef HEADER_TINYGETTEXT_TRANSLATOR_HPP
+#define HEADER_TINYGETTEXT_TRANSLATOR_HPP
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "dictionary.hpp"
+#include "language.hpp"
+
+namespace tinygettext {
+
+/** A lightweight handle for translating into a single language,
+    obtained from DictionaryManager::get_translator(). It holds on to
+    the dictionary snapshot (and thereby its fallback chain) it was
+    created from, so each call goes straight to the dictionary without
+    consulting the manager. A Translator is cheap to copy and can be
+    passed along with a request, multiple Translators for different
+    languages can be used from different threads at the same time.
+
+    A default constructed Translator returns all messages untranslated. */
+class Translator
+{
+private:
+  Language language;
+  std::shared_ptr<const Dictionary> dict;
+
+public:
+  Translator();
+  Translator(const Language& language, std::shared_ptr<const Dictionary> dict);
+
+  /** Returns the language this Translator translates into */
+  Language get_language() const { return language; }
+
+  /** Returns the dictionary snapshot used by this Translator */
+  std::shared_ptr<const Dictionary> get_dictionary() const { return dict; }
+
+  std::string translate(std::string_view msgid) const;
+  std::string translate_plural(std::string_view msgid, std::string_view msgidplural, int num) const;
+  std::string translate_ctxt(std::string_view msgctxt, std::string_view msgid) const;
+  std::string translate_ctxt_plural(std::string_view msgctxt, std::string_view msgid, std::string_view msgidplural, int num) const;
+
+  /** The *_view() variants behave like those of Dictionary, the
+      result remains valid for as long as this Translator or a copy of
+      it exists */
+  std::string_view translate_view(std::string_view msgid) const;
+  std::string_view translate_plural_view(std::string_view msgid, std::string_view msgidplural, int num) const;
+  std::string_view translate_ctxt_view(std::string_view msgctxt, std::string_view msgid) const;
+  std::string_view translate_ctxt_plural_view(std::string_view msgctxt, std::string_view msgid, std::string_view msgidplural, int num) const;
+};
+
+} // namespace tinygettext
+
+#endif
+
+/* EOF */
@@ -31,6 +31,10 @@ public:
 
   std::vector<std::string> open_directory(const std::string& pathname) override;
   std::unique_ptr<std::istream> open_file(const std::string& filename) override;
+  int64_t get_modification_time(const std::string& pathname) override;
+
+  /** Uses inotify on Linux, elsewhere files aren't watched */
+  std::unique_ptr<FileWatcher> create_watcher() override;
 };
 
 } // namespace tinygettext
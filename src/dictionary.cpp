@@ -18,9 +18,11 @@
 // 3. This notice may not be removed or altered from any source distribution.
 
 #include <assert.h>
+#include <ctype.h>
 
 #include "tinygettext/log_stream.hpp"
 #include "tinygettext/dictionary.hpp"
+#include "tinygettext/iconv.hpp"
 
 namespace tinygettext {
 
@@ -37,6 +39,25 @@ std::ostream& operator<<(std::ostream& o, const std::vector<std::string>& v)
   return o;
 }
 
+/** Called before \a entry gets a new translation, a finished
+    translation replaced by a fuzzy one is kept for when fuzzy
+    translations are disabled */
+void keep_finished(EntryTable::Entry& entry, bool fuzzy)
+{
+  if (!fuzzy)
+    entry.finished.clear();
+  else if (!entry.fuzzy)
+    entry.finished.swap(entry.msgstrs);
+}
+
+std::string normalize_charset(const std::string& charset)
+{
+  std::string result = charset;
+  for(std::string::iterator i = result.begin(); i != result.end(); ++i)
+    *i = static_cast<char>(toupper(*i));
+  return result;
+}
+
 } // namespace
 
 Dictionary::Dictionary(const std::string& charset_) :
@@ -45,7 +66,12 @@ Dictionary::Dictionary(const std::string& charset_) :
   charset(charset_),
   plural_forms(),
   m_has_fallback(false),
-  m_fallback()
+  m_fallback(),
+  m_fallback_owner(),
+  miss_tracker(),
+  use_fuzzy(true),
+  views_mutex(),
+  views()
 {
 }
 
@@ -71,29 +97,67 @@ Dictionary::get_plural_forms() const
   return plural_forms;
 }
 
-std::string
-Dictionary::translate_plural(const std::string& msgid, const std::string& msgid_plural, int num) const
+std::optional<EntryTable::Msgstrs>
+Dictionary::find(std::optional<std::string_view> msgctxt, std::string_view msgid,
+                 const Dictionary*& dict) const
 {
-  return translate_plural(entries, msgid, msgid_plural, num);
+  for(dict = this; dict; dict = dict->m_has_fallback ? dict->m_fallback : nullptr)
+  {
+    std::optional<EntryTable::Msgstrs> msgstrs = msgctxt ?
+      dict->ctxt_entries.find(*msgctxt, msgid) :
+      dict->entries.find(msgid);
+    // fuzzy translations are stored, but skipped while disabled, in
+    // favor of the finished translation they replaced, if any
+    if (msgstrs && msgstrs->is_fuzzy() && !dict->get_use_fuzzy())
+      msgstrs = msgstrs->finished();
+    if (msgstrs && !msgstrs->empty())
+      return msgstrs;
+  }
+  return std::nullopt;
+}
+
+void
+Dictionary::missed(std::optional<std::string_view> msgctxt,
+                   std::string_view msgid, std::string_view msgid_plural) const
+{
+  if (miss_tracker)
+    miss_tracker->record(msgctxt, msgid, msgid_plural);
+  else
+    log_info << "Couldn't translate: " << msgid << std::endl;
 }
 
 std::string
-Dictionary::translate_plural(const Entries& dict, const std::string& msgid, const std::string& msgid_plural, int count) const
+Dictionary::translate_plural(std::string_view msgid, std::string_view msgid_plural, int num) const
+{
+  return std::string(translate_plural_view(msgid, msgid_plural, num));
+}
+
+std::string_view
+Dictionary::translate_plural_view(std::string_view msgid, std::string_view msgid_plural, int num) const
+{
+  return translate_plural(std::nullopt, msgid, msgid_plural, num);
+}
+
+std::string_view
+Dictionary::translate_plural(std::optional<std::string_view> msgctxt,
+                             std::string_view msgid, std::string_view msgid_plural, int count) const
 {
-  Entries::const_iterator it = dict.find(msgid);
-  if (it != dict.end())
+  const Dictionary* dict;
+  std::optional<EntryTable::Msgstrs> msgstrs = find(msgctxt, msgid, dict);
+  if (msgstrs)
   {
-    unsigned int n = plural_forms.get_plural(count);
-    const std::vector<std::string>& msgstrs = it->second;
-    if (n >= msgstrs.size())
+    // the msgstrs are ordered by the plural forms of the dictionary
+    // they came from, which might be a fallback
+    unsigned int n = dict->plural_forms.get_plural(count);
+    if (n >= msgstrs->size())
     {
       log_error << "Plural translation not available (and not set to empty): '" << msgid << "'" << std::endl;
       log_error << "Missing plural form: " << n << std::endl;
       return msgid;
     }
 
-    if (!msgstrs[n].empty())
-      return msgstrs[n];
+    if (!(*msgstrs)[n].empty())
+      return (*msgstrs)[n];
     else
       if (count == 1) // default to english rules
         return msgid;
@@ -102,10 +166,7 @@ Dictionary::translate_plural(const Entries& dict, const std::string& msgid, cons
   }
   else
   {
-    log_info << "Couldn't translate: " << msgid << std::endl;
-    log_info << "Candidates: " << std::endl;
-    for (it = dict.begin(); it != dict.end(); ++it)
-      log_info << "'" << it->first << "'" << std::endl;
+    missed(msgctxt, msgid, msgid_plural);
 
     if (count == 1) // default to english rules
       return msgid;
@@ -115,130 +176,432 @@ Dictionary::translate_plural(const Entries& dict, const std::string& msgid, cons
 }
 
 std::string
-Dictionary::translate(const std::string& msgid) const
+Dictionary::translate(std::string_view msgid) const
 {
-  return translate(entries, msgid);
+  return std::string(translate_view(msgid));
 }
 
-std::string
-Dictionary::translate(const Entries& dict, const std::string& msgid) const
+std::string_view
+Dictionary::translate_view(std::string_view msgid) const
 {
-  Entries::const_iterator i = dict.find(msgid);
-  if (i != dict.end() && !i->second.empty())
-  {
-    return i->second[0];
-  }
-  else
-  {
-    log_info << "Couldn't translate: " << msgid << std::endl;
-
-    if (m_has_fallback) return m_fallback->translate(msgid);
-    else return msgid;
-  }
+  return translate(std::nullopt, msgid);
 }
 
-std::string
-Dictionary::translate_ctxt(const std::string& msgctxt, const std::string& msgid) const
+std::string_view
+Dictionary::translate(std::optional<std::string_view> msgctxt, std::string_view msgid) const
 {
-  CtxtEntries::const_iterator i = ctxt_entries.find(msgctxt);
-  if (i != ctxt_entries.end())
+  const Dictionary* dict;
+  std::optional<EntryTable::Msgstrs> msgstrs = find(msgctxt, msgid, dict);
+  if (msgstrs)
   {
-    return translate(i->second, msgid);
+    return (*msgstrs)[0];
   }
   else
   {
-    log_info << "Couldn't translate: " << msgid << std::endl;
+    missed(msgctxt, msgid, std::string_view());
     return msgid;
   }
 }
 
 std::string
-Dictionary::translate_ctxt_plural(const std::string& msgctxt,
-                                  const std::string& msgid, const std::string& msgidplural, int num) const
+Dictionary::translate_ctxt(std::string_view msgctxt, std::string_view msgid) const
+{
+  return std::string(translate_ctxt_view(msgctxt, msgid));
+}
+
+std::string_view
+Dictionary::translate_ctxt_view(std::string_view msgctxt, std::string_view msgid) const
+{
+  return translate(msgctxt, msgid);
+}
+
+std::string
+Dictionary::translate_ctxt_plural(std::string_view msgctxt,
+                                  std::string_view msgid, std::string_view msgidplural, int num) const
+{
+  return std::string(translate_ctxt_plural_view(msgctxt, msgid, msgidplural, num));
+}
+
+std::string_view
+Dictionary::translate_ctxt_plural_view(std::string_view msgctxt,
+                                       std::string_view msgid, std::string_view msgidplural, int num) const
 {
-  CtxtEntries::const_iterator i = ctxt_entries.find(msgctxt);
-  if (i != ctxt_entries.end())
+  return translate_plural(msgctxt, msgid, msgidplural, num);
+}
+
+void
+Dictionary::collision(const std::string_view* msgctxt, std::string_view msgid, std::string_view msgid_plural,
+                      const std::vector<std::string>& old_msgstrs, const std::vector<std::string>& msgstrs)
+{
+  if (old_msgstrs.size() != 1 || msgstrs.size() != 1)
   {
-    return translate_plural(i->second, msgid, msgidplural, num);
+    if (msgctxt)
+      log_warning << "collision in add_translation: '"
+                  << *msgctxt << "', '" << msgid << "', '" << msgid_plural
+                  << "' -> [" << old_msgstrs << "] vs [" << msgstrs << "]" << std::endl;
+    else
+      log_warning << "collision in add_translation: '"
+                  << msgid << "', '" << msgid_plural
+                  << "' -> [" << old_msgstrs << "] vs [" << msgstrs << "]" << std::endl;
   }
   else
   {
-    log_info << "Couldn't translate: " << msgid << std::endl;
-    if (num != 1) // default to english
-      return msgidplural;
+    if (msgctxt)
+      log_warning << "collision in add_translation: '"
+                  << *msgctxt << "', '" << msgid
+                  << "' -> '" << old_msgstrs[0] << "' vs '" << msgstrs[0] << "'" << std::endl;
     else
-      return msgid;
+      log_warning << "collision in add_translation: '"
+                  << msgid << "' -> '" << msgstrs[0] << "' vs '" << old_msgstrs[0] << "'" << std::endl;
   }
 }
 
 void
-Dictionary::add_translation(const std::string& msgid, const std::string& msgid_plural,
+Dictionary::store_entry(EntryTable::Entry& entry, std::vector<std::string>& msgstrs, bool fuzzy)
+{
+  // like keep_finished(), but the previous translation is handed back
+  if (!fuzzy)
+    entry.finished.clear();
+  else if (!entry.fuzzy)
+    entry.finished = entry.msgstrs;
+
+  entry.msgstrs.swap(msgstrs);
+  entry.fuzzy = fuzzy;
+}
+
+bool
+Dictionary::store_singular(EntryTable::Entry& entry, std::vector<std::string>& msgstrs, bool fuzzy)
+{
+  // keep the other plural forms of an entry that had them
+  if (entry.msgstrs.size() > 1)
+    msgstrs.insert(msgstrs.end(), entry.msgstrs.begin() + 1, entry.msgstrs.end());
+
+  store_entry(entry, msgstrs, fuzzy);
+  return !msgstrs.empty() && msgstrs[0] != entry.msgstrs[0];
+}
+
+void
+Dictionary::add_entry(EntryTable::Entry& entry, const std::string_view* msgctxt,
+                      std::string_view msgid, std::string_view msgid_plural,
+                      const std::vector<std::string>& msgstrs, bool fuzzy)
+{
+  std::vector<std::string> previous = msgstrs;
+  store_entry(entry, previous, fuzzy);
+  if (!previous.empty() && previous != entry.msgstrs)
+    collision(msgctxt, msgid, msgid_plural, previous, entry.msgstrs);
+}
+
+void
+Dictionary::add_entry(EntryTable::Entry& entry, const std::string_view* msgctxt,
+                      std::string_view msgid, std::string_view msgstr, bool fuzzy)
+{
+  std::vector<std::string> previous(1, std::string(msgstr));
+  if (store_singular(entry, previous, fuzzy))
+    collision(msgctxt, msgid, std::string_view(),
+              std::vector<std::string>(1, previous[0]), std::vector<std::string>(1, entry.msgstrs[0]));
+}
+
+void
+Dictionary::merge_entry(EntryTable::Entry& entry, EntryTable::Entry& other_entry)
+{
+  if (other_entry.fuzzy && other_entry.finished.empty())
+    keep_finished(entry, true);
+  else
+    entry.finished.swap(other_entry.finished);
+
+  entry.msgstrs.swap(other_entry.msgstrs);
+  entry.fuzzy = other_entry.fuzzy;
+}
+
+void
+Dictionary::add_translation(std::string_view msgid, std::string_view msgid_plural,
                             const std::vector<std::string>& msgstrs)
 {
-  std::vector<std::string>& vec = entries[msgid];
-  if (vec.empty())
-  {
-    vec = msgstrs;
-  }
-  else if (vec != msgstrs)
-  {
-    log_warning << "collision in add_translation: '"
-                << msgid << "', '" << msgid_plural
-                << "' -> [" << vec << "] vs [" << msgstrs << "]" << std::endl;
-    vec = msgstrs;
-  }
+  add_entry(entries.get(msgid), nullptr, msgid, msgid_plural, msgstrs, false);
+}
+
+void
+Dictionary::add_translation(std::string_view msgid, std::string_view msgstr)
+{
+  add_entry(entries.get(msgid), nullptr, msgid, msgstr, false);
 }
 
 void
-Dictionary::add_translation(const std::string& msgid, const std::string& msgstr)
+Dictionary::add_translation(std::string_view msgctxt,
+                            std::string_view msgid, std::string_view msgid_plural,
+                            const std::vector<std::string>& msgstrs)
 {
-  std::vector<std::string>& vec = entries[msgid];
-  if (vec.empty())
+  add_entry(ctxt_entries.get(msgctxt, msgid), &msgctxt, msgid, msgid_plural, msgstrs, false);
+}
+
+void
+Dictionary::add_translation(std::string_view msgctxt, std::string_view msgid, std::string_view msgstr)
+{
+  add_entry(ctxt_entries.get(msgctxt, msgid), &msgctxt, msgid, msgstr, false);
+}
+
+void
+Dictionary::add_fuzzy_translation(std::string_view msgid, std::string_view msgid_plural,
+                                  const std::vector<std::string>& msgstrs)
+{
+  add_entry(entries.get(msgid), nullptr, msgid, msgid_plural, msgstrs, true);
+}
+
+void
+Dictionary::add_fuzzy_translation(std::string_view msgid, std::string_view msgstr)
+{
+  add_entry(entries.get(msgid), nullptr, msgid, msgstr, true);
+}
+
+void
+Dictionary::add_fuzzy_translation(std::string_view msgctxt,
+                                  std::string_view msgid, std::string_view msgid_plural,
+                                  const std::vector<std::string>& msgstrs)
+{
+  add_entry(ctxt_entries.get(msgctxt, msgid), &msgctxt, msgid, msgid_plural, msgstrs, true);
+}
+
+void
+Dictionary::add_fuzzy_translation(std::string_view msgctxt, std::string_view msgid, std::string_view msgstr)
+{
+  add_entry(ctxt_entries.get(msgctxt, msgid), &msgctxt, msgid, msgstr, true);
+}
+
+bool
+Dictionary::store_translation(std::optional<std::string_view> msgctxt, std::string_view msgid,
+                              std::vector<std::string>& msgstrs, bool fuzzy, bool singular)
+{
+  EntryTable::Entry& entry = msgctxt ? ctxt_entries.get(*msgctxt, msgid) : entries.get(msgid);
+  if (singular)
+    return store_singular(entry, msgstrs, fuzzy);
+
+  store_entry(entry, msgstrs, fuzzy);
+  return !msgstrs.empty() && msgstrs != entry.msgstrs;
+}
+
+bool
+Dictionary::remove_translation(std::string_view msgid)
+{
+  return entries.erase(msgid);
+}
+
+bool
+Dictionary::remove_translation(std::string_view msgctxt, std::string_view msgid)
+{
+  return ctxt_entries.erase(msgctxt, msgid);
+}
+
+void
+Dictionary::merge_plural_forms(const Dictionary& other)
+{
+  if (!plural_forms)
   {
-    vec.push_back(msgstr);
+    plural_forms = other.plural_forms;
   }
-  else if (vec[0] != msgstr)
+  else if (other.plural_forms && plural_forms != other.plural_forms)
   {
-    log_warning << "collision in add_translation: '"
-                << msgid << "' -> '" << msgstr << "' vs '" << vec[0] << "'" << std::endl;
-    vec[0] = msgstr;
+    log_warning << "Plural-Forms missmatch between merged dictionaries" << std::endl;
   }
 }
 
 void
-Dictionary::add_translation(const std::string& msgctxt,
-                            const std::string& msgid, const std::string& msgid_plural,
-                            const std::vector<std::string>& msgstrs)
+Dictionary::merge(const Dictionary& other)
 {
-  std::vector<std::string>& vec = ctxt_entries[msgctxt][msgid];
-  if (vec.empty())
+  if (entries.empty() && ctxt_entries.empty())
   {
-    vec = msgstrs;
-  }
-  else if (vec != msgstrs)
-  {
-    log_warning << "collision in add_translation: '"
-                << msgctxt << "', '" << msgid << "', '" << msgid_plural
-                << "' -> [" << vec << "] vs [" << msgstrs << "]" << std::endl;
-    vec = msgstrs;
+    // nothing can collide, so the tables can be copied as they are,
+    // which for frozen tables is little more than a memcpy
+    merge_plural_forms(other);
+    entries = other.entries;
+    ctxt_entries = other.ctxt_entries;
+    return;
   }
+
+  Dictionary copy;
+  copy.plural_forms = other.plural_forms;
+  copy.entries = other.entries;
+  copy.ctxt_entries = other.ctxt_entries;
+  merge(std::move(copy));
+}
+
+void
+Dictionary::merge(Dictionary&& other)
+{
+  merge(std::move(other), MergeCallback());
 }
 
 void
-Dictionary::add_translation(const std::string& msgctxt, const std::string& msgid, const std::string& msgstr)
+Dictionary::merge(Dictionary&& other, const MergeCallback& replaced)
 {
-  std::vector<std::string>& vec = ctxt_entries[msgctxt][msgid];
-  if (vec.empty())
+  merge_plural_forms(other);
+
+  entries.merge(std::move(other.entries), [&replaced](EntryTable::Entry& entry, EntryTable::Entry& other_entry, size_t index) {
+    if (replaced && !entry.msgstrs.empty())
+      replaced(entry, other_entry, false, index);
+    merge_entry(entry, other_entry);
+  });
+  ctxt_entries.merge(std::move(other.ctxt_entries), [&replaced](EntryTable::Entry& entry, EntryTable::Entry& other_entry, size_t index) {
+    if (replaced && !entry.msgstrs.empty())
+      replaced(entry, other_entry, true, index);
+    merge_entry(entry, other_entry);
+  });
+}
+
+void
+Dictionary::patch(const Dictionary& base, const Dictionary& removed, const Dictionary& changed)
+{
+  plural_forms = base.plural_forms;
+  merge_plural_forms(changed);
+
+  entries.assign_patched(base.entries, removed.entries, changed.entries);
+  ctxt_entries.assign_patched(base.ctxt_entries, removed.ctxt_entries, changed.ctxt_entries);
+}
+
+void
+Dictionary::merge_fallback(const Dictionary& fallback)
+{
+  if (!plural_forms)
+    plural_forms = fallback.plural_forms;
+
+  const bool merge_plurals = !fallback.plural_forms || plural_forms == fallback.plural_forms;
+  auto merge = [merge_plurals](EntryTable& table, const EntryTable& fallback_table) {
+    fallback_table.foreach_entry([&table, merge_plurals](const EntryTable::Entry& fallback_entry) {
+      // what a lookup along the chain would find in the fallback
+      // while fuzzy translations are enabled and while they aren't
+      const std::vector<std::string>& msgstrs = fallback_entry.msgstrs;
+      const std::vector<std::string>& finished = fallback_entry.fuzzy ? fallback_entry.finished : fallback_entry.msgstrs;
+      const bool use_msgstrs = !msgstrs.empty() && (merge_plurals || msgstrs.size() == 1);
+      const bool use_finished = !finished.empty() && (merge_plurals || finished.size() == 1);
+
+      // keys of ctxt_entries are stored joined, so they can be passed
+      // as they are
+      std::optional<EntryTable::Msgstrs> existing = table.find(fallback_entry.key);
+      if (!existing || existing->empty())
+      {
+        if (use_msgstrs)
+        {
+          EntryTable::Entry& entry = table.get(fallback_entry.key);
+          entry.msgstrs = msgstrs;
+          entry.fuzzy = fallback_entry.fuzzy;
+          entry.finished = (fallback_entry.fuzzy && use_finished) ? finished : std::vector<std::string>();
+        }
+        else if (use_finished)
+        {
+          EntryTable::Entry& entry = table.get(fallback_entry.key);
+          entry.msgstrs = finished;
+          entry.fuzzy = false;
+          entry.finished.clear();
+        }
+      }
+      else if (existing->is_fuzzy() && existing->finished().empty() && use_finished)
+      {
+        // the fuzzy translation only hides the one of the fallback
+        // while fuzzy translations are enabled
+        table.get(fallback_entry.key).finished = finished;
+      }
+    });
+  };
+
+  merge(entries, fallback.entries);
+  merge(ctxt_entries, fallback.ctxt_entries);
+}
+
+void
+Dictionary::freeze(bool perfect_hash)
+{
+  entries.freeze(perfect_hash);
+  ctxt_entries.freeze(perfect_hash);
+}
+
+bool
+Dictionary::is_frozen() const
+{
+  return entries.is_frozen();
+}
+
+void
+Dictionary::set_use_fuzzy(bool t)
+{
+  use_fuzzy.store(t, std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> lock(views_mutex);
+  for(Views::iterator i = views.begin(); i != views.end(); ++i)
   {
-    vec.push_back(msgstr);
+    if (i->second)
+      i->second->set_use_fuzzy(t);
   }
-  else if (vec[0] != msgstr)
+}
+
+Dictionary&
+Dictionary::get_view(const std::string& charset_)
+{
+  Dictionary* view = find_view(charset_);
+  return view ? *view : *this;
+}
+
+const Dictionary&
+Dictionary::get_view(const std::string& charset_) const
+{
+  const Dictionary* view = find_view(charset_);
+  return view ? *view : *this;
+}
+
+Dictionary*
+Dictionary::find_view(const std::string& charset_) const
+{
+  const std::string to_charset = normalize_charset(charset_);
+  if (to_charset == normalize_charset(charset))
+    return nullptr;
+
+  std::lock_guard<std::mutex> lock(views_mutex);
+  Views::iterator view = views.find(to_charset);
+  if (view == views.end())
   {
-    log_warning << "collision in add_translation: '"
-                << msgctxt << "', '" << msgid
-                << "' -> '" << vec[0] << "' vs '" << msgstr << "'" << std::endl;
-    vec[0] = msgstr;
+    IConv conv;
+    try
+    {
+      conv.set_charsets(charset, to_charset);
+    }
+    catch(std::exception& e)
+    {
+      // remembered as a missing view, so that the warning isn't
+      // repeated on every call
+      log_warning << "warning: " << e.what() << ", using " << charset << " instead" << std::endl;
+      views.emplace(to_charset, std::unique_ptr<Dictionary>());
+      return nullptr;
+    }
+
+    std::unique_ptr<Dictionary> result(new Dictionary(to_charset));
+    // only the msgstrs are converted, the msgids stay as they are, the
+    // same as when a .po file is parsed into a dictionary
+    auto convert = [&conv](EntryTable& table, const EntryTable& source) {
+      source.foreach_entry([&table, &conv](const EntryTable::Entry& source_entry) {
+        EntryTable::Entry& entry = table.get(source_entry.key);
+        entry.msgstrs.reserve(source_entry.msgstrs.size());
+        for(std::vector<std::string>::const_iterator i = source_entry.msgstrs.begin(); i != source_entry.msgstrs.end(); ++i)
+          entry.msgstrs.push_back(conv.convert(*i));
+        entry.fuzzy = source_entry.fuzzy;
+        for(std::vector<std::string>::const_iterator i = source_entry.finished.begin(); i != source_entry.finished.end(); ++i)
+          entry.finished.push_back(conv.convert(*i));
+      });
+    };
+    convert(result->entries, entries);
+    convert(result->ctxt_entries, ctxt_entries);
+    result->entries.freeze(entries.has_perfect_hash());
+    result->ctxt_entries.freeze(ctxt_entries.has_perfect_hash());
+
+    result->plural_forms = plural_forms;
+    result->miss_tracker = miss_tracker;
+    result->use_fuzzy.store(get_use_fuzzy(), std::memory_order_relaxed);
+    if (m_has_fallback)
+    {
+      result->m_has_fallback = true;
+      result->m_fallback = m_fallback ? &m_fallback->get_view(to_charset) : nullptr;
+    }
+
+    view = views.emplace(to_charset, std::move(result)).first;
   }
+  return view->second.get();
 }
 
 } // namespace tinygettext
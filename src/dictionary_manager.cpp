@@ -21,13 +21,16 @@
 
 #include <memory>
 #include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <fstream>
+#include <iterator>
 #include <algorithm>
 
 #include "tinygettext/file_system.hpp"
 #include "tinygettext/log_stream.hpp"
+#include "tinygettext/po_block_index.hpp"
 #include "tinygettext/po_parser.hpp"
 #include "tinygettext/unix_file_system.hpp"
 
@@ -41,145 +44,860 @@ static bool has_suffix(const std::string& lhs, const std::string& rhs)
     return lhs.compare(lhs.length() - rhs.length(), rhs.length(), rhs) == 0;
 }
 
+/** The view of \a dict in \a charset, which keeps \a dict alive */
+static std::shared_ptr<Dictionary> in_charset(const std::shared_ptr<Dictionary>& dict, const std::string& charset)
+{
+  return std::shared_ptr<Dictionary>(dict, &dict->get_view(charset));
+}
+
+DictionaryManager::Loaded
+DictionaryManager::make_loaded(const std::shared_ptr<Dictionary>& dict, const std::string& charset)
+{
+  return Loaded{dict, in_charset(dict, charset), charset};
+}
+
 DictionaryManager::DictionaryManager(const std::string& charset_) :
   DictionaryManager(std::unique_ptr<FileSystem>(new UnixFileSystem), charset_)
 {
 }
 
 DictionaryManager::DictionaryManager(std::unique_ptr<FileSystem> filesystem_, const std::string& charset_) :
-  dictionaries(),
-  search_path(),
+  dictionaries(std::make_shared<const LoadedDictionaries>()),
+  state_mutex(),
+  loading(),
+  generation(0),
+  async_loads(),
+  async_tasks(0),
+  async_done(),
+  async_loading(false),
+  executor(),
+  search_path(std::make_shared<const SearchPath>()),
+  search_path_mutex(),
+  watcher(),
+  watch_thread(),
+  reload_delay(200),
+  watching(false),
+  index_mutex(),
+  indices(),
+  layer_mutex(),
+  layers(),
+  fallbacks(),
   charset(charset_),
   use_fuzzy(true),
+  use_perfect_hash(false),
+  flatten_fallbacks(false),
   current_language(),
+  current_owner(),
   current_dict(nullptr),
-  empty_dict(),
+  retired(),
+  empty_dict(std::make_shared<Dictionary>()),
+  miss_tracker(std::make_shared<MissTracker>()),
   filesystem(std::move(filesystem_))
 {
+  empty_dict->set_miss_tracker(miss_tracker);
 }
 
 DictionaryManager::~DictionaryManager()
 {
-  for(Dictionaries::iterator i = dictionaries.begin(); i != dictionaries.end(); ++i)
+  set_watch_files(false);
+
+  // background loads still refer to this
+  std::unique_lock<std::mutex> lock(state_mutex);
+  async_done.wait(lock, [this]{ return async_tasks == 0; });
+}
+
+void
+DictionaryManager::clear_cache()
+{
+  std::lock_guard<std::mutex> lock(state_mutex);
+
+  // dictionaries still referenced by a snapshot stay alive until the
+  // last snapshot is gone, threads waiting for a load still get the
+  // result of that load
+  dictionaries.store(std::make_shared<const LoadedDictionaries>());
+  loading.clear();
+  generation += 1;
+
+  current_owner.reset();
+  current_dict = nullptr;
+  retired.clear();
+}
+
+void
+DictionaryManager::clear_layers(const std::string& prefix)
+{
+  std::lock_guard<std::mutex> lock(layer_mutex);
+  for(Layers::iterator i = layers.begin(); i != layers.end();)
   {
-    delete i->second;
+    if (i->first.compare(0, prefix.size(), prefix) == 0)
+      i = layers.erase(i);
+    else
+      ++i;
   }
 }
 
 void
-DictionaryManager::clear_cache()
+DictionaryManager::reload()
 {
-  for(Dictionaries::iterator i = dictionaries.begin(); i != dictionaries.end(); ++i)
+  std::lock_guard<std::mutex> search_path_lock(search_path_mutex);
+  clear_layers();
   {
-    delete i->second;
+    std::lock_guard<std::mutex> lock(index_mutex);
+    indices.clear();
   }
-  dictionaries.clear();
 
-  current_dict = nullptr;
+  std::set<Language> languages;
+  std::shared_ptr<const LoadedDictionaries> current = dictionaries.load();
+  for(LoadedDictionaries::const_iterator i = current->begin(); i != current->end(); ++i)
+  {
+    languages.insert(i->first);
+  }
+  reload_languages(languages);
+}
+
+void
+DictionaryManager::reload_languages(const std::set<Language>& changed)
+{
+  std::shared_ptr<const LoadedDictionaries> current = dictionaries.load();
+
+  // languages falling back to a changed one have to be linked to the
+  // new dictionary (or merged with it) as well
+  std::set<Language> affected;
+  for(LoadedDictionaries::const_iterator i = current->begin(); i != current->end(); ++i)
+  {
+    for(std::set<Language>::const_iterator c = changed.begin(); c != changed.end(); ++c)
+    {
+      if (in_fallback_chain(i->first, *c))
+      {
+        affected.insert(i->first);
+        break;
+      }
+    }
+  }
+
+  if (affected.empty())
+  {
+    // a language that is still loading might have used the old files
+    std::lock_guard<std::mutex> lock(state_mutex);
+    loading.clear();
+    generation += 1;
+    return;
+  }
+
+  Dictionaries rebuilt;
+  for(std::set<Language>::const_iterator i = affected.begin(); i != affected.end(); ++i)
+  {
+    rebuild_dictionary(*i, affected, *current, rebuilt);
+  }
+
+  // the views are made before taking the lock
+  LoadedDictionaries rebuilt_views;
+  const std::string view_charset = get_charset();
+  for(Dictionaries::iterator i = rebuilt.begin(); i != rebuilt.end(); ++i)
+  {
+    rebuilt_views[i->first] = make_loaded(i->second, view_charset);
+  }
+
+  std::lock_guard<std::mutex> lock(state_mutex);
+
+  // loads that are still running might have used the old search path
+  loading.clear();
+  generation += 1;
+
+  // keep the languages that were loaded in the meantime
+  std::shared_ptr<LoadedDictionaries> next = std::make_shared<LoadedDictionaries>(*dictionaries.load());
+  for(LoadedDictionaries::iterator i = rebuilt_views.begin(); i != rebuilt_views.end(); ++i)
+  {
+    i->second.dict->set_use_fuzzy(use_fuzzy);
+    if (i->second.charset != charset)
+      i->second = make_loaded(i->second.dict, charset);
+
+    // get_dictionary() might have returned a reference to the old one
+    LoadedDictionaries::iterator old = next->find(i->first);
+    if (old != next->end())
+      retired.push_back(old->second.dict);
+    (*next)[i->first] = i->second;
+  }
+  dictionaries.store(next);
+
+  LoadedDictionaries::iterator it = next->find(current_language);
+  current_owner = (it != next->end()) ? it->second.view : std::shared_ptr<Dictionary>();
+  current_dict = current_owner.get();
+}
+
+std::shared_ptr<Dictionary>
+DictionaryManager::rebuild_dictionary(const Language& language, const std::set<Language>& affected,
+                                      const LoadedDictionaries& current, Dictionaries& rebuilt)
+{
+  Dictionaries::iterator i = rebuilt.find(language);
+  if (i != rebuilt.end())
+    return i->second;
+
+  LoadedDictionaries::const_iterator old = current.find(language);
+  if (old != current.end() && !affected.count(language))
+    return old->second.dict;
+
+  std::shared_ptr<Dictionary> dict = parse_dictionary(language);
+  rebuilt[language] = dict;
+
+  std::shared_ptr<Dictionary> fallback_dict;
+  Language fallback = get_fallback(language);
+  // a misconfigured circular chain would otherwise loop forever
+  if (fallback && !in_fallback_chain(fallback, language))
+    fallback_dict = rebuild_dictionary(fallback, affected, current, rebuilt);
+  finish_dictionary(*dict, fallback_dict);
+
+  return dict;
 }
 
 Dictionary&
 DictionaryManager::get_dictionary()
 {
-  if (current_dict)
+  Dictionary* dict = current_dict.load();
+  if (dict)
   {
-    return *current_dict;
+    return *dict;
   }
   else
   {
-    if (current_language)
+    std::unique_lock<std::mutex> lock(state_mutex);
+    const Language language = current_language;
+    const unsigned int current_generation = generation;
+    lock.unlock();
+
+    if (language && async_loading)
     {
-      current_dict = &get_dictionary(current_language);
-      return *current_dict;
+      std::shared_ptr<Dictionary> shared = find_loaded(language).view;
+      if (!shared)
+      {
+        load_async(language);
+
+        // use what we have until the language is loaded, it isn't
+        // cached, so the next call checks again
+        std::set<Language> visited;
+        for(Language fallback = get_fallback(language);
+            fallback && visited.insert(fallback).second;
+            fallback = get_fallback(fallback))
+        {
+          shared = find_loaded(fallback).view;
+          if (shared)
+            return *shared;
+        }
+        return *empty_dict;
+      }
+
+      lock.lock();
+      if (language == current_language && current_generation == generation)
+      {
+        current_owner = shared;
+        current_dict = shared.get();
+      }
+      return *shared;
+    }
+    else if (language)
+    {
+      std::shared_ptr<Dictionary> shared = get_loaded(language).view;
+
+      lock.lock();
+      // the language might have changed while we were loading
+      if (language == current_language && current_generation == generation)
+      {
+        current_owner = shared;
+        current_dict = shared.get();
+      }
+      return *shared;
     }
     else
     {
-      return empty_dict;
+      return *empty_dict;
     }
   }
 }
 
 Dictionary&
 DictionaryManager::get_dictionary(const Language& language)
+{
+  return *get_loaded(language).view;
+}
+
+std::shared_ptr<const Dictionary>
+DictionaryManager::get_snapshot(const Language& language)
+{
+  return get_loaded(language).view;
+}
+
+std::shared_ptr<const Dictionary>
+DictionaryManager::get_snapshot(const Language& language, const std::string& to_charset)
+{
+  Loaded loaded = get_loaded(language);
+  if (to_charset == loaded.charset)
+    return loaded.view;
+  else
+    return in_charset(loaded.dict, to_charset);
+}
+
+std::shared_ptr<const Dictionary>
+DictionaryManager::get_snapshot()
+{
+  Language language = get_language();
+  if (language)
+    return get_snapshot(language);
+  else
+    return empty_dict;
+}
+
+DictionaryManager::Loaded
+DictionaryManager::find_loaded(const Language& language) const
+{
+  std::shared_ptr<const LoadedDictionaries> current = dictionaries.load();
+  LoadedDictionaries::const_iterator i = current->find(language);
+  if (i != current->end())
+    return i->second;
+  else
+    return Loaded();
+}
+
+DictionaryManager::LoadFuture
+DictionaryManager::load_async(const Language& language, LoadCallback callback)
+{
+  assert(language);
+
+  std::shared_ptr<Dictionary> dict = find_loaded(language).dict;
+  if (dict)
+  {
+    if (callback)
+      callback(language, dict);
+
+    std::promise<std::shared_ptr<const Dictionary> > promise;
+    promise.set_value(dict);
+    return promise.get_future().share();
+  }
+
+  std::shared_ptr<AsyncLoad> load;
+  {
+    std::lock_guard<std::mutex> lock(state_mutex);
+
+    AsyncLoads::iterator i = async_loads.find(language);
+    if (i != async_loads.end())
+    {
+      if (callback)
+        i->second->callbacks.push_back(std::move(callback));
+      return i->second->future;
+    }
+
+    load = std::make_shared<AsyncLoad>();
+    load->future = load->promise.get_future().share();
+    if (callback)
+      load->callbacks.push_back(std::move(callback));
+    async_loads[language] = load;
+    async_tasks += 1;
+  }
+
+  get_executor()->execute([this, language, load]{ run_async_load(language, load); });
+  return load->future;
+}
+
+void
+DictionaryManager::run_async_load(const Language& language, const std::shared_ptr<AsyncLoad>& load)
+{
+  std::shared_ptr<const Dictionary> dict;
+  std::exception_ptr error;
+  try
+  {
+    dict = get_shared(language);
+  }
+  catch(...)
+  {
+    error = std::current_exception();
+  }
+
+  std::vector<LoadCallback> callbacks;
+  {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    AsyncLoads::iterator i = async_loads.find(language);
+    if (i != async_loads.end() && i->second == load)
+      async_loads.erase(i);
+    callbacks.swap(load->callbacks);
+  }
+
+  if (error)
+    load->promise.set_exception(error);
+  else
+    load->promise.set_value(dict);
+
+  for(std::vector<LoadCallback>::iterator i = callbacks.begin(); i != callbacks.end(); ++i)
+  {
+    try
+    {
+      (*i)(language, dict);
+    }
+    catch(std::exception& e)
+    {
+      log_error << "error: load callback for " << language.str() << " failed: " << e.what() << std::endl;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(state_mutex);
+  async_tasks -= 1;
+  async_done.notify_all();
+}
+
+/** Shared between preload() and the tasks it hands to the executor,
+    tasks that run after preload() returned find nothing to do */
+struct DictionaryManager::Preload
+{
+  struct Node
+  {
+    Language language;
+    /** The languages that fall back to this one */
+    std::vector<size_t> dependents;
+  };
+
+  /** Not modified once the tasks are started */
+  std::vector<Node> nodes;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<size_t> ready;
+  size_t remaining;
+  std::exception_ptr error;
+};
+
+void
+DictionaryManager::preload(const std::set<Language>& languages)
+{
+  ThreadPool pool;
+  preload(languages, pool);
+}
+
+void
+DictionaryManager::preload(const std::set<Language>& languages, Executor& exec)
+{
+  std::shared_ptr<Preload> state = std::make_shared<Preload>();
+
+  // collect the languages along with their fallback chains
+  std::unordered_map<Language, size_t, Language_hash> index;
+  std::deque<Language> todo(languages.begin(), languages.end());
+  while(!todo.empty())
+  {
+    Language language = todo.front();
+    todo.pop_front();
+    if (!language || index.count(language) || find_loaded(language).dict)
+      continue;
+
+    index[language] = state->nodes.size();
+    state->nodes.push_back(Preload::Node{language, std::vector<size_t>()});
+
+    Language fallback = get_fallback(language);
+    if (fallback && !in_fallback_chain(fallback, language))
+      todo.push_back(fallback);
+  }
+
+  // a language becomes ready once its fallback is loaded
+  for(size_t i = 0; i < state->nodes.size(); ++i)
+  {
+    const Language& language = state->nodes[i].language;
+    Language fallback = get_fallback(language);
+    std::unordered_map<Language, size_t, Language_hash>::iterator it = index.find(fallback);
+    if (fallback && it != index.end() && !in_fallback_chain(fallback, language))
+      state->nodes[it->second].dependents.push_back(i);
+    else
+      state->ready.push_back(i);
+  }
+  state->remaining = state->nodes.size();
+
+  const size_t initially_ready = state->ready.size();
+  for(size_t i = 0; i < initially_ready; ++i)
+  {
+    exec.execute([this, state, &exec]{ preload_step(state, exec); });
+  }
+
+  // work along instead of just waiting, so that progress doesn't
+  // depend on the executor having a free thread
+  std::unique_lock<std::mutex> lock(state->mutex);
+  while(state->remaining != 0)
+  {
+    if (!state->ready.empty())
+    {
+      lock.unlock();
+      preload_step(state, exec);
+      lock.lock();
+    }
+    else
+    {
+      state->cond.wait(lock);
+    }
+  }
+
+  if (state->error)
+    std::rethrow_exception(state->error);
+}
+
+bool
+DictionaryManager::preload_step(const std::shared_ptr<Preload>& state, Executor& exec)
+{
+  size_t i;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->ready.empty())
+      return false;
+    i = state->ready.front();
+    state->ready.pop_front();
+  }
+
+  std::exception_ptr error;
+  try
+  {
+    get_shared(state->nodes[i].language);
+  }
+  catch(...)
+  {
+    error = std::current_exception();
+  }
+
+  const std::vector<size_t>& dependents = state->nodes[i].dependents;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (error && !state->error)
+      state->error = error;
+    state->ready.insert(state->ready.end(), dependents.begin(), dependents.end());
+  }
+
+  // preload() is still waiting for us, so exec is still alive
+  for(size_t d = 0; d < dependents.size(); ++d)
+  {
+    exec.execute([this, state, &exec]{ preload_step(state, exec); });
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->remaining -= 1;
+  }
+  state->cond.notify_all();
+  return true;
+}
+
+void
+DictionaryManager::set_async_loading(bool t)
+{
+  async_loading = t;
+}
+
+bool
+DictionaryManager::get_async_loading() const
+{
+  return async_loading;
+}
+
+void
+DictionaryManager::set_executor(std::shared_ptr<Executor> executor_)
+{
+  std::lock_guard<std::mutex> lock(state_mutex);
+  executor = std::move(executor_);
+}
+
+Translator
+DictionaryManager::get_translator(const Language& language)
+{
+  return Translator(language, get_loaded(language).view);
+}
+
+Translator
+DictionaryManager::get_translator(const Language& language, const std::string& to_charset)
+{
+  return Translator(language, get_snapshot(language, to_charset));
+}
+
+Translator
+DictionaryManager::get_translator()
+{
+  Language language = get_language();
+  if (language)
+    return get_translator(language);
+  else
+    return Translator(language, empty_dict);
+}
+
+std::shared_ptr<Dictionary>
+DictionaryManager::get_shared(const Language& language)
+{
+  return get_loaded(language).dict;
+}
+
+DictionaryManager::Loaded
+DictionaryManager::get_loaded(const Language& language)
 {
   //log_debug << "Dictionary for language \"" << spec << "\" requested" << std::endl;
   //log_debug << "...normalized as \"" << lang << "\"" << std::endl;
   assert(language);
 
-  Dictionaries::iterator i = dictionaries.find(language);
-  if (i != dictionaries.end())
+  std::shared_ptr<const LoadedDictionaries> current = dictionaries.load();
+  LoadedDictionaries::const_iterator i = current->find(language);
+  if (i != current->end())
   {
-    return *i->second;
+    return i->second;
   }
-  else // Dictionary for languages lang isn't loaded, so we load it
+
+  // Dictionary for languages lang isn't loaded, so we load it, unless
+  // another thread is already doing so
+  std::shared_ptr<Loading> slot;
+  unsigned int load_generation;
   {
-    //log_debug << "get_dictionary: " << lang << std::endl;
-    Dictionary* dict = new Dictionary(charset);
+    std::unique_lock<std::mutex> lock(state_mutex);
 
-    dictionaries[language] = dict;
+    current = dictionaries.load();
+    i = current->find(language);
+    if (i != current->end())
+      return i->second;
 
-    for (SearchPath::reverse_iterator p = search_path.rbegin(); p != search_path.rend(); ++p)
+    LoadingMap::iterator l = loading.find(language);
+    if (l != loading.end())
     {
-      std::vector<std::string> files = filesystem->open_directory(*p);
+      slot = l->second;
+      lock.unlock();
 
-      std::string best_filename;
-      int best_score = 0;
+      std::unique_lock<std::mutex> slot_lock(slot->mutex);
+      slot->cond.wait(slot_lock, [&slot]{ return slot->done; });
+      if (slot->error)
+        std::rethrow_exception(slot->error);
+      return slot->loaded;
+    }
 
-      for (std::vector<std::string>::iterator filename = files.begin(); filename != files.end(); ++filename)
-      {
-        // check if filename matches requested language
-        if (has_suffix(*filename, ".po"))
-        { // ignore anything that isn't a .po file
+    slot = std::make_shared<Loading>();
+    loading[language] = slot;
+    load_generation = generation;
+  }
 
-          Language po_language = Language::from_env(convertFilename2Language(*filename));
+  Loaded loaded;
+  std::exception_ptr error;
+  try
+  {
+    // parsing happens without holding a lock, so that other
+    // languages can be loaded at the same time
+    std::shared_ptr<Dictionary> dict = parse_dictionary(language);
 
-          if (!po_language)
-          {
-            log_warning << *filename << ": warning: ignoring, unknown language" << std::endl;
-          }
-          else
-          {
-            int score = Language::match(language, po_language);
+    std::shared_ptr<Dictionary> fallback_dict;
+    Language fallback = get_fallback(language);
+    // a misconfigured circular chain would otherwise loop forever
+    if (fallback && !in_fallback_chain(fallback, language))
+      fallback_dict = get_shared(fallback);
+    finish_dictionary(*dict, fallback_dict);
 
-            if (score > best_score)
-            {
-              best_score = score;
-              best_filename = *filename;
-            }
-          }
-        }
+    // the same goes for converting it to the manager's charset
+    loaded = make_loaded(dict, get_charset());
+  }
+  catch(...)
+  {
+    error = std::current_exception();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(state_mutex);
+
+    // a load started before the cache was cleared must not end up in
+    // the new cache
+    if (!error && load_generation == generation)
+      publish(language, loaded);
+
+    LoadingMap::iterator l = loading.find(language);
+    if (l != loading.end() && l->second == slot)
+      loading.erase(l);
+  }
+
+  {
+    std::lock_guard<std::mutex> slot_lock(slot->mutex);
+    slot->done = true;
+    slot->loaded = loaded;
+    slot->error = error;
+  }
+  slot->cond.notify_all();
+
+  if (error)
+    std::rethrow_exception(error);
+  return loaded;
+}
+
+void
+DictionaryManager::publish(const Language& language, Loaded& loaded)
+{
+  loaded.dict->set_use_fuzzy(use_fuzzy);
+
+  // the charset might have changed since the view was made
+  if (loaded.charset != charset)
+    loaded = make_loaded(loaded.dict, charset);
+
+  // build a new map besides the published one, readers keep using
+  // the old map until the new one is complete
+  std::shared_ptr<LoadedDictionaries> next = std::make_shared<LoadedDictionaries>(*dictionaries.load());
+  (*next)[language] = loaded;
+  dictionaries.store(next);
+}
+
+std::shared_ptr<Dictionary>
+DictionaryManager::parse_dictionary(const Language& language)
+{
+  //log_debug << "get_dictionary: " << lang << std::endl;
+  std::shared_ptr<Dictionary> dict = std::make_shared<Dictionary>();
+  dict->set_miss_tracker(miss_tracker);
+
+  // the best matching file of each search path, lowest priority first
+  std::vector<std::string> pofiles;
+  std::shared_ptr<const SearchPath> path = search_path.load();
+  for (SearchPath::const_reverse_iterator p = path->rbegin(); p != path->rend(); ++p)
+  {
+    std::string best_filename = get_index(*p)->find(language);
+    if (!best_filename.empty())
+    {
+      pofiles.push_back(*p + "/" + best_filename);
+    }
+  }
+
+  // reuse the files that were already parsed for an earlier version
+  // of this dictionary, parse the others in parallel
+  std::vector<Layer> parts(pofiles.size());
+  std::vector<Layer> old_parts(pofiles.size());
+  std::vector<size_t> missing;
+  {
+    std::lock_guard<std::mutex> lock(layer_mutex);
+    for(size_t i = 0; i < pofiles.size(); ++i)
+    {
+      const int64_t mtime = filesystem->get_modification_time(pofiles[i]);
+      Layers::iterator it = layers.find(pofiles[i]);
+      // without a modification time the file may have changed
+      if (it != layers.end() && mtime != 0 && it->second.mtime == mtime)
+      {
+        parts[i] = it->second;
+      }
+      else
+      {
+        // an outdated layer is kept to only parse what changed
+        if (it != layers.end())
+          old_parts[i] = it->second;
+        parts[i].mtime = mtime;
+        missing.push_back(i);
       }
+    }
+  }
+
+  if (!missing.empty())
+  {
+    parallel_for(*get_executor(), missing.size(), [this, &pofiles, &parts, &old_parts, &missing](size_t i) {
+      const size_t part = missing[i];
+      load_layer(pofiles[part], old_parts[part], parts[part]);
+    });
+
+    std::lock_guard<std::mutex> lock(layer_mutex);
+    for(std::vector<size_t>::iterator i = missing.begin(); i != missing.end(); ++i)
+    {
+      layers[pofiles[*i]] = parts[*i];
+    }
+  }
+
+  // merge them in order, so that later files override earlier ones
+  // just as if they were parsed one after another
+  for(size_t i = 0; i < parts.size(); ++i)
+  {
+    dict->merge(*parts[i].dict);
+  }
+
+  return dict;
+}
+
+void
+DictionaryManager::load_layer(const std::string& pofile, const Layer& old, Layer& layer)
+{
+  std::shared_ptr<Dictionary> dict = std::make_shared<Dictionary>();
+
+  // indexing takes time as well, so it is only done when the file
+  // might be reloaded
+  std::shared_ptr<POBlockIndex> blocks;
+  if (watching)
+    blocks = std::make_shared<POBlockIndex>();
+
+  try
+  {
+    std::unique_ptr<std::istream> in = filesystem->open_file(pofile);
+    if (!in)
+    {
+      log_error << "error: failure opening: " << pofile << std::endl;
+      blocks.reset();
+    }
+    else
+    {
+      const std::string text((std::istreambuf_iterator<char>(*in)), std::istreambuf_iterator<char>());
+      if (blocks && !blocks->build(text))
+        blocks.reset();
 
-      if (!best_filename.empty())
+      POBlockIndex::Diff diff;
+      if (old.dict && old.blocks && blocks && blocks->diff(*old.blocks, text, diff))
       {
-        std::string pofile = *p + "/" + best_filename;
-        try
-        {
-          std::unique_ptr<std::istream> in = filesystem->open_file(pofile);
-          if (!in)
-          {
-            log_error << "error: failure opening: " << pofile << std::endl;
-          }
-          else
-          {
-            POParser::parse(pofile, *in, *dict);
-          }
-        }
-        catch(std::exception& e)
+        // only the entries that changed are parsed, the others are
+        // taken from the old version
+        // the removed keys come with a dummy msgstr, whatever the
+        // parser has to say about them was already said when the old
+        // version was loaded
+        std::vector<PODiagnostic> ignored;
+        Dictionary removed;
+        POParser::parse(pofile, diff.removed, removed, &ignored);
+
+        std::vector<PODiagnostic> diagnostics;
+        Dictionary changed;
+        POParser::parse(pofile, diff.changed, changed, &diagnostics);
+
+        // the header is unchanged, so are its diagnostics
+        const int header_end = (diff.changed_lines.size() > 1) ? diff.changed_lines[1].first : INT_MAX;
+        for(std::vector<PODiagnostic>::iterator d = diagnostics.begin(); d != diagnostics.end(); ++d)
         {
-          log_error << "error: failure parsing: " << pofile << std::endl;
-          log_error << e.what() << "" << std::endl;
+          if (d->line_number < header_end)
+            continue;
+          d->line_number = diff.file_line(d->line_number);
+          POParser::log(*d);
         }
+
+        // the new version is laid out straight from the frozen old
+        // one, without thawing it
+        dict->patch(*old.dict, removed, changed);
+      }
+      else
+      {
+        // large files are split up and parsed in parallel
+        POParser::parse(pofile, text, *dict, *get_executor());
       }
     }
+  }
+  catch(std::exception& e)
+  {
+    log_error << "error: failure parsing: " << pofile << std::endl;
+    log_error << e.what() << "" << std::endl;
+    blocks.reset();
+  }
 
-    if (!language.get_country().empty())
-    {
-        // printf("Adding language fallback %s\n", language.get_language().c_str());
-        dict->addFallback( &get_dictionary(Language::from_spec(language.get_language())) );
-    }
-    return *dict;
+  dict->freeze();
+  layer.dict = dict;
+  layer.blocks = blocks;
+}
+
+std::shared_ptr<Executor>
+DictionaryManager::get_executor()
+{
+  std::lock_guard<std::mutex> lock(state_mutex);
+  if (!executor)
+    executor = std::make_shared<ThreadPool>();
+  return executor;
+}
+
+void
+DictionaryManager::finish_dictionary(Dictionary& dict, const std::shared_ptr<Dictionary>& fallback_dict)
+{
+  if (fallback_dict)
+  {
+    if (flatten_fallbacks)
+      dict.merge_fallback(*fallback_dict);
+    else
+      dict.addFallback(std::shared_ptr<const Dictionary>(fallback_dict));
   }
+
+  dict.freeze(use_perfect_hash);
 }
 
 std::set<Language>
@@ -187,76 +905,458 @@ DictionaryManager::get_languages()
 {
   std::set<Language> languages;
 
-  for (SearchPath::iterator p = search_path.begin(); p != search_path.end(); ++p)
+  std::shared_ptr<const SearchPath> path = search_path.load();
+  for (SearchPath::const_iterator p = path->begin(); p != path->end(); ++p)
   {
-    std::vector<std::string> files = filesystem->open_directory(*p);
+    std::shared_ptr<const DirectoryIndex> index = get_index(*p);
 
-    for(std::vector<std::string>::iterator file = files.begin(); file != files.end(); ++file)
+    for(std::vector<std::string>::const_iterator file = index->filenames.begin(); file != index->filenames.end(); ++file)
     {
-      if (has_suffix(*file, ".po"))
+      languages.insert(Language::from_env(file->substr(0, file->size()-3)));
+    }
+  }
+  return languages;
+}
+
+std::shared_ptr<const DictionaryManager::DirectoryIndex>
+DictionaryManager::get_index(const std::string& pathname, bool rescan)
+{
+  const int64_t mtime = filesystem->get_modification_time(pathname);
+
+  std::lock_guard<std::mutex> lock(index_mutex);
+  DirectoryIndices::iterator it = indices.find(pathname);
+  if (it != indices.end() && mtime != 0 && it->second->mtime == mtime && !rescan)
+  {
+    return it->second;
+  }
+  else
+  {
+    const unsigned int index_generation = (it != indices.end()) ? it->second->generation + 1 : 0;
+    std::shared_ptr<const DirectoryIndex> index = scan_directory(pathname, mtime, index_generation);
+    indices[pathname] = index;
+    return index;
+  }
+}
+
+std::shared_ptr<const DictionaryManager::DirectoryIndex>
+DictionaryManager::scan_directory(const std::string& pathname, int64_t mtime, unsigned int index_generation)
+{
+  std::shared_ptr<DirectoryIndex> index = std::make_shared<DirectoryIndex>();
+  index->mtime = mtime;
+  index->generation = index_generation;
+
+  std::vector<std::string> files;
+  try
+  {
+    files = filesystem->open_directory(pathname);
+  }
+  catch(std::exception& e)
+  {
+    log_error << "error: failure reading directory: " << pathname << std::endl;
+    log_error << e.what() << "" << std::endl;
+  }
+
+  for (std::vector<std::string>::iterator filename = files.begin(); filename != files.end(); ++filename)
+  {
+    if (has_suffix(*filename, ".po"))
+    { // ignore anything that isn't a .po file
+
+      Language po_language = Language::from_env(convertFilename2Language(*filename));
+
+      if (!po_language)
       {
-        languages.insert(Language::from_env(file->substr(0, file->size()-3)));
+        log_warning << *filename << ": warning: ignoring, unknown language" << std::endl;
       }
+
+      index->filenames.push_back(*filename);
+      index->languages.push_back(po_language);
     }
   }
-  return languages;
+
+  return index;
+}
+
+std::set<Language>
+DictionaryManager::get_affected_languages(const DirectoryIndex& index) const
+{
+  std::set<Language> affected;
+  std::shared_ptr<const LoadedDictionaries> current = dictionaries.load();
+  for(LoadedDictionaries::const_iterator i = current->begin(); i != current->end(); ++i)
+  {
+    if (!index.find(i->first).empty())
+      affected.insert(i->first);
+  }
+  return affected;
+}
+
+std::string
+DictionaryManager::DirectoryIndex::find(const Language& language) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  std::unordered_map<Language, std::string, Language_hash>::iterator it = best.find(language);
+  if (it != best.end())
+    return it->second;
+
+  std::string best_filename;
+  int best_score = 0;
+  for(size_t i = 0; i < filenames.size(); ++i)
+  {
+    // check if filename matches requested language
+    if (languages[i])
+    {
+      int score = Language::match(language, languages[i]);
+
+      if (score > best_score)
+      {
+        best_score = score;
+        best_filename = filenames[i];
+      }
+    }
+  }
+
+  best[language] = best_filename;
+  return best_filename;
 }
 
 void
 DictionaryManager::set_language(const Language& language)
 {
-  if (current_language != language)
   {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    if (current_language == language)
+      return;
+
     current_language = language;
+    current_owner.reset();
     current_dict     = nullptr;
   }
+
+  if (async_loading && language)
+    load_async(language);
 }
 
 Language
 DictionaryManager::get_language() const
 {
+  std::lock_guard<std::mutex> lock(state_mutex);
   return current_language;
 }
 
+void
+DictionaryManager::set_fallback(const Language& language, const Language& fallback)
+{
+  clear_cache(); // changing fallbacks invalidates cache
+  fallbacks[language] = fallback;
+}
+
+Language
+DictionaryManager::get_fallback(const Language& language) const
+{
+  Fallbacks::const_iterator it = fallbacks.find(language);
+  if (it != fallbacks.end())
+    return it->second;
+  else if (!language.get_country().empty())
+    return Language::from_spec(language.get_language());
+  else
+    return Language();
+}
+
+bool
+DictionaryManager::in_fallback_chain(const Language& language, const Language& member) const
+{
+  std::set<Language> visited;
+  for(Language lang = language; lang && visited.insert(lang).second; lang = get_fallback(lang))
+  {
+    if (lang == member)
+      return true;
+  }
+  return false;
+}
+
+void
+DictionaryManager::set_flatten_fallbacks(bool t)
+{
+  clear_cache();
+  flatten_fallbacks = t;
+}
+
+bool
+DictionaryManager::get_flatten_fallbacks() const
+{
+  return flatten_fallbacks;
+}
+
 void
 DictionaryManager::set_charset(const std::string& charset_)
 {
-  clear_cache(); // changing charset invalidates cache
+  // the dictionaries are kept in UTF-8, only the views handed out
+  // change, so nothing has to be loaded again
+  std::lock_guard<std::mutex> lock(state_mutex);
   charset = charset_;
+
+  std::shared_ptr<LoadedDictionaries> next = std::make_shared<LoadedDictionaries>(*dictionaries.load());
+  for(LoadedDictionaries::iterator i = next->begin(); i != next->end(); ++i)
+  {
+    i->second = make_loaded(i->second.dict, charset);
+  }
+  dictionaries.store(next);
+
+  current_owner.reset();
+  current_dict = nullptr;
+}
+
+std::string
+DictionaryManager::get_charset() const
+{
+  std::lock_guard<std::mutex> lock(state_mutex);
+  return charset;
 }
 
 void
 DictionaryManager::set_use_fuzzy(bool t)
 {
-  clear_cache();
+  // fuzzy translations are always loaded, so switching only changes
+  // which of them the loaded dictionaries use
+  std::lock_guard<std::mutex> lock(state_mutex);
   use_fuzzy = t;
+
+  std::shared_ptr<const LoadedDictionaries> current = dictionaries.load();
+  for(LoadedDictionaries::const_iterator i = current->begin(); i != current->end(); ++i)
+  {
+    i->second.dict->set_use_fuzzy(use_fuzzy);
+  }
+  empty_dict->set_use_fuzzy(use_fuzzy);
 }
 
 bool
 DictionaryManager::get_use_fuzzy() const
 {
+  std::lock_guard<std::mutex> lock(state_mutex);
   return use_fuzzy;
 }
 
+std::shared_ptr<MissTracker>
+DictionaryManager::get_miss_tracker() const
+{
+  return miss_tracker;
+}
+
+void
+DictionaryManager::set_miss_tracker(std::shared_ptr<MissTracker> tracker)
+{
+  miss_tracker = std::move(tracker);
+  empty_dict->set_miss_tracker(miss_tracker);
+  clear_cache();
+}
+
+void
+DictionaryManager::set_use_perfect_hash(bool t)
+{
+  use_perfect_hash = t;
+}
+
+bool
+DictionaryManager::get_use_perfect_hash() const
+{
+  return use_perfect_hash;
+}
+
+void
+DictionaryManager::set_watch_files(bool t)
+{
+  if (t && !watcher)
+  {
+    watcher = filesystem->create_watcher();
+    if (!watcher)
+    {
+      log_warning << "warning: the file system doesn't support watching files" << std::endl;
+      return;
+    }
+
+    std::lock_guard<std::mutex> search_path_lock(search_path_mutex);
+    std::shared_ptr<const SearchPath> path = search_path.load();
+    for(SearchPath::const_iterator p = path->begin(); p != path->end(); ++p)
+    {
+      watcher->add_directory(*p);
+    }
+    watching = true;
+    watch_thread = std::thread(&DictionaryManager::watch_files, this);
+  }
+  else if (!t && watcher)
+  {
+    watching = false;
+    watcher->stop();
+    watch_thread.join();
+    watcher.reset();
+  }
+}
+
+bool
+DictionaryManager::get_watch_files() const
+{
+  return watcher != nullptr;
+}
+
+void
+DictionaryManager::set_reload_delay(int milliseconds)
+{
+  reload_delay = milliseconds;
+}
+
+int
+DictionaryManager::get_reload_delay() const
+{
+  return reload_delay;
+}
+
+void
+DictionaryManager::watch_files()
+{
+  std::set<std::string> changed;
+  std::vector<std::string> files;
+  bool overflow = false;
+  bool reload_all = false;
+
+  // wait for the first change, then until the changes stop coming in
+  while (watcher->wait((changed.empty() && !reload_all) ? -1 : reload_delay.load(), files, overflow))
+  {
+    if (!files.empty() || overflow)
+    {
+      for(std::vector<std::string>::iterator i = files.begin(); i != files.end(); ++i)
+      {
+        if (has_suffix(*i, ".po"))
+          changed.insert(*i);
+      }
+      files.clear();
+
+      // the watcher lost track of some changes
+      reload_all = reload_all || overflow;
+      overflow = false;
+    }
+    else if (!changed.empty() || reload_all)
+    {
+      try
+      {
+        if (reload_all)
+        {
+          // files added or removed within the modification time
+          // resolution of their directory would go unnoticed
+          {
+            std::lock_guard<std::mutex> lock(index_mutex);
+            indices.clear();
+          }
+          reload();
+        }
+        else
+          reload_files(changed);
+      }
+      catch(std::exception& e)
+      {
+        log_error << "error: reloading changed files failed: " << e.what() << std::endl;
+      }
+      changed.clear();
+      reload_all = false;
+    }
+  }
+}
+
+void
+DictionaryManager::reload_files(const std::set<std::string>& files)
+{
+  std::lock_guard<std::mutex> search_path_lock(search_path_mutex);
+  std::shared_ptr<const LoadedDictionaries> current = dictionaries.load();
+
+  std::set<Language> changed;
+  std::shared_ptr<const SearchPath> path = search_path.load();
+  for(SearchPath::const_iterator p = path->begin(); p != path->end(); ++p)
+  {
+    const std::string prefix = *p + "/";
+    std::set<std::string> filenames;
+    for(std::set<std::string>::const_iterator i = files.begin(); i != files.end(); ++i)
+    {
+      if (i->compare(0, prefix.size(), prefix) == 0)
+      {
+        filenames.insert(i->substr(prefix.size()));
+        // the modification time might not have changed, when the
+        // file was saved twice within its resolution
+        std::lock_guard<std::mutex> lock(layer_mutex);
+        Layers::iterator layer = layers.find(*i);
+        if (layer != layers.end())
+          layer->second.mtime = -1;
+      }
+    }
+
+    if (!filenames.empty())
+    {
+      std::shared_ptr<const DirectoryIndex> old_index;
+      {
+        std::lock_guard<std::mutex> lock(index_mutex);
+        DirectoryIndices::iterator it = indices.find(*p);
+        if (it != indices.end())
+          old_index = it->second;
+      }
+
+      // a file that was added or removed can change which file a
+      // language uses
+      std::shared_ptr<const DirectoryIndex> index = get_index(*p, true);
+      for(LoadedDictionaries::const_iterator i = current->begin(); i != current->end(); ++i)
+      {
+        if (filenames.count(index->find(i->first)) ||
+            (old_index && filenames.count(old_index->find(i->first))))
+        {
+          changed.insert(i->first);
+        }
+      }
+    }
+  }
+
+  reload_languages(changed);
+}
+
 void
 DictionaryManager::add_directory(const std::string& pathname, bool precedence /* = false */)
 {
-  if(std::find(search_path.begin(), search_path.end(), pathname) == search_path.end()) {
-    clear_cache(); // adding directories invalidates cache
+  std::lock_guard<std::mutex> search_path_lock(search_path_mutex);
+  std::shared_ptr<const SearchPath> path = search_path.load();
+  if(std::find(path->begin(), path->end(), pathname) == path->end()) {
+    std::shared_ptr<SearchPath> next = std::make_shared<SearchPath>(*path);
     if(precedence)
-      search_path.push_front(pathname);
+      next->push_front(pathname);
     else
-      search_path.push_back(pathname);
+      next->push_back(pathname);
+    search_path.store(next);
+
+    if (watcher)
+      watcher->add_directory(pathname);
+
+    // only the languages with a file in the new directory change
+    reload_languages(get_affected_languages(*get_index(pathname)));
   }
 }
 
 void
 DictionaryManager::remove_directory(const std::string& pathname)
 {
-  SearchPath::iterator it = find(search_path.begin(), search_path.end(), pathname);
-  if(it != search_path.end()) {
-    clear_cache(); // removing directories invalidates cache
-    search_path.erase(it);
+  std::lock_guard<std::mutex> search_path_lock(search_path_mutex);
+  std::shared_ptr<const SearchPath> path = search_path.load();
+  SearchPath::const_iterator it = find(path->begin(), path->end(), pathname);
+  if(it != path->end()) {
+    std::set<Language> affected = get_affected_languages(*get_index(pathname));
+
+    if (watcher)
+      watcher->remove_directory(pathname);
+
+    std::shared_ptr<SearchPath> next = std::make_shared<SearchPath>(*path);
+    next->erase(next->begin() + (it - path->begin()));
+    search_path.store(next);
+    {
+      std::lock_guard<std::mutex> lock(index_mutex);
+      indices.erase(pathname);
+    }
+    clear_layers(pathname + "/");
+
+    reload_languages(affected);
   }
 }
 
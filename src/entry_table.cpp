@@ -0,0 +1,793 @@
+// tinygettext - A gettext replacement that works directly on .po files
+// Copyright (c) 2006 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgement in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "tinygettext/entry_table.hpp"
+
+#include <algorithm>
+
+namespace tinygettext {
+
+namespace {
+
+// splitmix64 finalizer
+inline uint64_t mix(uint64_t x)
+{
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ull;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebull;
+  x ^= x >> 31;
+  return x;
+}
+
+/** FNV-1a leaves the high bits of short keys poorly distributed, so
+    they are mixed before they pick the bucket */
+inline size_t bucket_of(uint64_t h, size_t bucket_count)
+{
+  return static_cast<size_t>((mix(h) >> 32) % bucket_count);
+}
+
+inline uint64_t pilot_hash(uint64_t h, uint64_t seed, uint32_t pilot)
+{
+  return mix(h ^ ((seed + pilot) * 0x9e3779b97f4a7c15ull));
+}
+
+} // namespace
+
+uint64_t
+EntryTable::hash(uint64_t h, std::string_view text)
+{
+  // FNV-1a
+  for(std::string_view::const_iterator i = text.begin(); i != text.end(); ++i)
+  {
+    h ^= static_cast<unsigned char>(*i);
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+uint64_t
+EntryTable::hash(std::string_view text)
+{
+  return hash(14695981039346656037ull, text);
+}
+
+uint64_t
+EntryTable::Key::hash() const
+{
+  if (!has_ctxt)
+  {
+    return EntryTable::hash(msgid);
+  }
+  else
+  {
+    // same as hashing the joined key, as FNV-1a works bytewise
+    const char separator[] = { ctxt_separator };
+    uint64_t h = EntryTable::hash(msgctxt);
+    h = EntryTable::hash(h, std::string_view(separator, 1));
+    return EntryTable::hash(h, msgid);
+  }
+}
+
+bool
+EntryTable::Key::operator==(std::string_view key) const
+{
+  if (!has_ctxt)
+  {
+    return key == msgid;
+  }
+  else
+  {
+    return (key.size() == msgctxt.size() + 1 + msgid.size() &&
+            key.compare(0, msgctxt.size(), msgctxt) == 0 &&
+            key[msgctxt.size()] == ctxt_separator &&
+            key.compare(msgctxt.size() + 1, msgid.size(), msgid) == 0);
+  }
+}
+
+EntryTable::EntryTable() :
+  slots(),
+  entries(),
+  frozen(false),
+  arena(),
+  offsets(),
+  first(),
+  fuzzy(),
+  mph_seed(0),
+  mph_size(0),
+  pilots(),
+  remap()
+{
+}
+
+uint32_t
+EntryTable::find_index(const Key& key, uint32_t h) const
+{
+  const size_t mask = slots.size() - 1;
+  for(size_t i = h & mask; ; i = (i + 1) & mask)
+  {
+    const Slot& slot = slots[i];
+    if (slot.index == empty_slot)
+      return empty_slot;
+    else if (slot.hash == h)
+    {
+      if (frozen ? key == get_string(first[slot.index]) : key == entries[slot.index].key)
+        return slot.index;
+    }
+  }
+}
+
+size_t
+EntryTable::perfect_hash_position(uint64_t h) const
+{
+  const uint32_t pilot = pilots[bucket_of(h, pilots.size())];
+  const size_t pos = static_cast<size_t>(pilot_hash(h, mph_seed, pilot) % mph_size);
+  if (pos < first.size() - 1)
+    return pos;
+  else
+    return remap[pos - (first.size() - 1)];
+}
+
+std::optional<EntryTable::Msgstrs>
+EntryTable::find(std::string_view msgid) const
+{
+  return find(Key{std::string_view(), msgid, false});
+}
+
+std::optional<EntryTable::Msgstrs>
+EntryTable::find(std::string_view msgctxt, std::string_view msgid) const
+{
+  return find(Key{msgctxt, msgid, true});
+}
+
+uint32_t
+EntryTable::find_index(const Key& key) const
+{
+  if (!pilots.empty())
+  {
+    const uint32_t index = static_cast<uint32_t>(perfect_hash_position(key.hash()));
+    return (key == get_string(first[index])) ? index : empty_slot;
+  }
+  else if (slots.empty())
+  {
+    return empty_slot;
+  }
+  else
+  {
+    return find_index(key, static_cast<uint32_t>(key.hash()));
+  }
+}
+
+std::optional<EntryTable::Msgstrs>
+EntryTable::find(const Key& key) const
+{
+  const uint32_t index = find_index(key);
+  if (index == empty_slot)
+  {
+    return std::nullopt;
+  }
+  else if (!frozen)
+  {
+    const Entry& entry = entries[index];
+    return Msgstrs(entry.msgstrs, entry.fuzzy, &entry.finished);
+  }
+  else
+  {
+    const uint32_t count = first[index + 1] - first[index] - 1;
+    if (fuzzy.empty() || !fuzzy[index])
+      return Msgstrs(arena.data(), &offsets[first[index] + 1], count);
+    else
+      return Msgstrs(arena.data(), &offsets[first[index] + 1], fuzzy[index] - 1, true,
+                     count - (fuzzy[index] - 1));
+  }
+}
+
+EntryTable::Entry
+EntryTable::get_entry(size_t i) const
+{
+  const uint32_t count = (fuzzy.empty() || !fuzzy[i]) ? first[i + 1] - first[i] - 1 : fuzzy[i] - 1;
+
+  Entry entry;
+  entry.key = get_string(first[i]);
+  entry.fuzzy = !fuzzy.empty() && fuzzy[i];
+  for(uint32_t j = first[i] + 1; j < first[i + 1]; ++j)
+  {
+    if (j <= first[i] + count)
+      entry.msgstrs.emplace_back(get_string(j));
+    else
+      entry.finished.emplace_back(get_string(j));
+  }
+  return entry;
+}
+
+EntryTable::Entry&
+EntryTable::get(std::string_view msgid)
+{
+  return get(Key{std::string_view(), msgid, false});
+}
+
+EntryTable::Entry&
+EntryTable::get(std::string_view msgctxt, std::string_view msgid)
+{
+  return get(Key{msgctxt, msgid, true});
+}
+
+EntryTable::Entry&
+EntryTable::get(const Key& key)
+{
+  if (frozen)
+    thaw();
+
+  // keep the load factor below 7/8
+  if ((entries.size() + 1) * 8 > slots.size() * 7)
+    grow();
+
+  const uint32_t h = static_cast<uint32_t>(key.hash());
+  const size_t mask = slots.size() - 1;
+  size_t i = h & mask;
+  for(; slots[i].index != empty_slot; i = (i + 1) & mask)
+  {
+    if (slots[i].hash == h && key == entries[slots[i].index].key)
+      return entries[slots[i].index];
+  }
+
+  Entry entry;
+  if (key.has_ctxt)
+  {
+    entry.key.reserve(key.msgctxt.size() + 1 + key.msgid.size());
+    entry.key += key.msgctxt;
+    entry.key += ctxt_separator;
+  }
+  entry.key += key.msgid;
+
+  slots[i].hash = h;
+  slots[i].index = static_cast<uint32_t>(entries.size());
+  entries.push_back(std::move(entry));
+  return entries.back();
+}
+
+bool
+EntryTable::erase(std::string_view msgid)
+{
+  return erase(Key{std::string_view(), msgid, false});
+}
+
+bool
+EntryTable::erase(std::string_view msgctxt, std::string_view msgid)
+{
+  return erase(Key{msgctxt, msgid, true});
+}
+
+bool
+EntryTable::erase(const Key& key)
+{
+  if (frozen)
+    thaw();
+
+  if (slots.empty())
+    return false;
+
+  const uint32_t h = static_cast<uint32_t>(key.hash());
+  const size_t mask = slots.size() - 1;
+  size_t i = h & mask;
+  for(; slots[i].index != empty_slot; i = (i + 1) & mask)
+  {
+    if (slots[i].hash == h && key == entries[slots[i].index].key)
+      break;
+  }
+  if (slots[i].index == empty_slot)
+    return false;
+
+  const uint32_t index = slots[i].index;
+
+  // shift the following slots of the probe sequence back, unless
+  // they are already at or before their home slot
+  for(size_t j = (i + 1) & mask; slots[j].index != empty_slot; j = (j + 1) & mask)
+  {
+    const size_t home = slots[j].hash & mask;
+    const bool in_between = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+    if (!in_between)
+    {
+      slots[i] = slots[j];
+      i = j;
+    }
+  }
+  slots[i] = Slot{0, empty_slot};
+
+  // move the last entry into the gap
+  const uint32_t last = static_cast<uint32_t>(entries.size() - 1);
+  if (index != last)
+  {
+    entries[index] = std::move(entries[last]);
+    size_t k = static_cast<uint32_t>(hash(entries[index].key)) & mask;
+    while (slots[k].index != last)
+      k = (k + 1) & mask;
+    slots[k].index = index;
+  }
+  entries.pop_back();
+
+  return true;
+}
+
+void
+EntryTable::merge(EntryTable&& other,
+                  const std::function<void (Entry& entry, Entry& other_entry, size_t other_index)>& merge_entry)
+{
+  if (empty())
+  {
+    *this = std::move(other);
+    other = EntryTable();
+    return;
+  }
+
+  if (frozen)
+    thaw();
+  if (other.frozen)
+    other.thaw();
+
+  while ((entries.size() + other.entries.size()) * 8 > slots.size() * 7)
+    grow();
+
+  // the hashes of the other entries are already in its slots
+  std::vector<uint32_t> hashes(other.entries.size());
+  for(std::vector<Slot>::const_iterator slot = other.slots.begin(); slot != other.slots.end(); ++slot)
+  {
+    if (slot->index != empty_slot)
+      hashes[slot->index] = slot->hash;
+  }
+
+  const size_t mask = slots.size() - 1;
+  for(size_t index = 0; index < other.entries.size(); ++index)
+  {
+    Entry& entry = other.entries[index];
+    const uint32_t h = hashes[index];
+    size_t i = h & mask;
+    while (slots[i].index != empty_slot &&
+           !(slots[i].hash == h && entries[slots[i].index].key == entry.key))
+    {
+      i = (i + 1) & mask;
+    }
+
+    if (slots[i].index != empty_slot)
+    {
+      merge_entry(entries[slots[i].index], entry, index);
+    }
+    else
+    {
+      slots[i] = Slot{h, static_cast<uint32_t>(entries.size())};
+      entries.push_back(std::move(entry));
+    }
+  }
+
+  other = EntryTable();
+}
+
+void
+EntryTable::grow()
+{
+  std::vector<Slot> old_slots(slots.empty() ? 16 : slots.size() * 2, Slot{0, empty_slot});
+  old_slots.swap(slots);
+
+  const size_t mask = slots.size() - 1;
+  for(std::vector<Slot>::const_iterator slot = old_slots.begin(); slot != old_slots.end(); ++slot)
+  {
+    if (slot->index != empty_slot)
+    {
+      size_t i = slot->hash & mask;
+      while (slots[i].index != empty_slot)
+        i = (i + 1) & mask;
+      slots[i] = *slot;
+    }
+  }
+}
+
+void
+EntryTable::rebuild_slots()
+{
+  std::vector<Slot>().swap(slots);
+  while (entries.size() * 8 > slots.size() * 7)
+    grow();
+
+  const size_t mask = slots.size() - 1;
+  for(uint32_t index = 0; index < entries.size(); ++index)
+  {
+    const uint32_t h = static_cast<uint32_t>(hash(entries[index].key));
+    size_t i = h & mask;
+    while (slots[i].index != empty_slot)
+      i = (i + 1) & mask;
+    slots[i] = Slot{h, index};
+  }
+}
+
+bool
+EntryTable::build_perfect_hash(std::vector<uint32_t>& order)
+{
+  const size_t n = entries.size();
+  const size_t bucket_count = n / 4 + 1;
+  const uint64_t table_size = n + n / 64 + 1;
+
+  std::vector<uint64_t> hashes(n);
+  for(size_t i = 0; i < n; ++i)
+    hashes[i] = hash(entries[i].key);
+
+  // sort the keys into buckets
+  std::vector<uint32_t> bucket_start(bucket_count + 1, 0);
+  for(size_t i = 0; i < n; ++i)
+    bucket_start[bucket_of(hashes[i], bucket_count) + 1] += 1;
+  size_t max_bucket_size = 0;
+  for(size_t b = 0; b < bucket_count; ++b)
+  {
+    max_bucket_size = std::max<size_t>(max_bucket_size, bucket_start[b + 1]);
+    bucket_start[b + 1] += bucket_start[b];
+  }
+  std::vector<uint32_t> bucket_keys(n);
+  {
+    std::vector<uint32_t> fill(bucket_start.begin(), bucket_start.end() - 1);
+    for(uint32_t i = 0; i < n; ++i)
+      bucket_keys[fill[bucket_of(hashes[i], bucket_count)]++] = i;
+  }
+
+  // place the largest buckets first, while the table is still empty
+  std::vector<uint32_t> bucket_order;
+  bucket_order.reserve(bucket_count);
+  {
+    std::vector<uint32_t> size_start(max_bucket_size + 2, 0);
+    for(size_t b = 0; b < bucket_count; ++b)
+      size_start[max_bucket_size - (bucket_start[b + 1] - bucket_start[b]) + 1] += 1;
+    for(size_t k = 0; k + 1 < size_start.size(); ++k)
+      size_start[k + 1] += size_start[k];
+    bucket_order.resize(bucket_count);
+    for(uint32_t b = 0; b < bucket_count; ++b)
+      bucket_order[size_start[max_bucket_size - (bucket_start[b + 1] - bucket_start[b])]++] = b;
+  }
+
+  for(uint64_t seed = 0; seed < 4; ++seed)
+  {
+    std::vector<bool> taken(table_size, false);
+    std::vector<uint64_t> positions(n);
+    std::vector<uint32_t> bucket_pilots(bucket_count, 0);
+    bool success = true;
+
+    for(std::vector<uint32_t>::const_iterator b = bucket_order.begin(); b != bucket_order.end() && success; ++b)
+    {
+      const uint32_t* keys = &bucket_keys[0] + bucket_start[*b];
+      const uint32_t* keys_end = &bucket_keys[0] + bucket_start[*b + 1];
+      if (keys == keys_end)
+        break;
+
+      for(uint32_t pilot = 0; ; ++pilot)
+      {
+        // with the table only 98% full a free position is found
+        // quickly, hitting the limit means the keys can't be separated
+        if (pilot == (1u << 16))
+        {
+          success = false;
+          break;
+        }
+
+        bool collision = false;
+        for(const uint32_t* k = keys; k != keys_end && !collision; ++k)
+        {
+          positions[*k] = pilot_hash(hashes[*k], seed, pilot) % table_size;
+          if (taken[positions[*k]])
+            collision = true;
+          for(const uint32_t* j = keys; j != k && !collision; ++j)
+            if (positions[*j] == positions[*k])
+              collision = true;
+        }
+
+        if (!collision)
+        {
+          for(const uint32_t* k = keys; k != keys_end; ++k)
+            taken[positions[*k]] = true;
+          bucket_pilots[*b] = pilot;
+          break;
+        }
+      }
+    }
+
+    if (success)
+    {
+      // map the positions past the end onto the free ones
+      std::vector<uint32_t> tail_remap(table_size - n, 0);
+      size_t free_pos = 0;
+      for(size_t pos = n; pos < table_size; ++pos)
+      {
+        if (taken[pos])
+        {
+          while (taken[free_pos])
+            free_pos += 1;
+          tail_remap[pos - n] = static_cast<uint32_t>(free_pos);
+          taken[free_pos] = true;
+        }
+      }
+
+      order.resize(n);
+      for(uint32_t i = 0; i < n; ++i)
+      {
+        const uint64_t pos = positions[i];
+        order[pos < n ? pos : tail_remap[pos - n]] = i;
+      }
+
+      mph_seed = seed;
+      mph_size = table_size;
+      pilots.swap(bucket_pilots);
+      remap.swap(tail_remap);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void
+EntryTable::freeze(bool perfect_hash)
+{
+  if (frozen)
+  {
+    // a table frozen without a perfect hash has to be laid out again
+    if (!perfect_hash || !pilots.empty() || empty())
+      return;
+    thaw();
+  }
+
+  size_t arena_size = 0;
+  size_t string_count = 0;
+  bool has_fuzzy = false;
+  for(std::vector<Entry>::const_iterator i = entries.begin(); i != entries.end(); ++i)
+  {
+    has_fuzzy = has_fuzzy || i->fuzzy;
+    arena_size += i->key.size();
+    for(std::vector<std::string>::const_iterator j = i->msgstrs.begin(); j != i->msgstrs.end(); ++j)
+      arena_size += j->size();
+    for(std::vector<std::string>::const_iterator j = i->finished.begin(); j != i->finished.end(); ++j)
+      arena_size += j->size();
+    string_count += 1 + i->msgstrs.size() + i->finished.size();
+  }
+
+  // offsets are stored as 32bit, tables that don't fit stay unfrozen
+  if (arena_size > 0xffffffffu || string_count >= 0xffffffffu)
+    return;
+
+  // with a perfect hash the entries are laid out in hash order
+  std::vector<uint32_t> order;
+  if (!perfect_hash || entries.empty() || !build_perfect_hash(order))
+  {
+    order.resize(entries.size());
+    for(uint32_t i = 0; i < entries.size(); ++i)
+      order[i] = i;
+  }
+
+  arena.reserve(arena_size);
+  offsets.reserve(string_count + 1);
+  first.reserve(entries.size() + 1);
+  if (has_fuzzy)
+    fuzzy.reserve(entries.size());
+
+  offsets.push_back(0);
+  for(std::vector<uint32_t>::const_iterator index = order.begin(); index != order.end(); ++index)
+  {
+    append_frozen(entries[*index], has_fuzzy);
+  }
+  first.push_back(static_cast<uint32_t>(offsets.size() - 1));
+
+  std::vector<Entry>().swap(entries);
+  if (!pilots.empty())
+    std::vector<Slot>().swap(slots);
+  frozen = true;
+}
+
+void
+EntryTable::append_frozen(const Entry& entry, bool has_fuzzy)
+{
+  first.push_back(static_cast<uint32_t>(offsets.size() - 1));
+  if (has_fuzzy)
+    fuzzy.push_back(entry.fuzzy ? static_cast<uint32_t>(entry.msgstrs.size()) + 1 : 0);
+
+  arena += entry.key;
+  offsets.push_back(static_cast<uint32_t>(arena.size()));
+  for(std::vector<std::string>::const_iterator j = entry.msgstrs.begin(); j != entry.msgstrs.end(); ++j)
+  {
+    arena += *j;
+    offsets.push_back(static_cast<uint32_t>(arena.size()));
+  }
+  if (entry.fuzzy)
+  {
+    for(std::vector<std::string>::const_iterator j = entry.finished.begin(); j != entry.finished.end(); ++j)
+    {
+      arena += *j;
+      offsets.push_back(static_cast<uint32_t>(arena.size()));
+    }
+  }
+}
+
+void
+EntryTable::assign_patched(const EntryTable& base, const EntryTable& removed, const EntryTable& added)
+{
+  std::vector<Entry> added_entries;
+  added_entries.reserve(added.size());
+  added.foreach_entry([&added_entries](const Entry& entry) {
+    added_entries.push_back(entry);
+  });
+
+  // the keys are joined already, so they are looked up without context
+  std::vector<bool> dropped;
+  size_t arena_size = 0;
+  size_t string_count = 0;
+  bool has_fuzzy = false;
+  if (base.frozen)
+  {
+    const size_t base_count = base.first.size() - 1;
+    dropped.resize(base_count, false);
+    arena_size = base.arena.size();
+    string_count = base.offsets.size() - 1;
+    has_fuzzy = !base.fuzzy.empty();
+
+    auto drop = [&base, &dropped, &arena_size, &string_count](const Entry& entry) {
+      const uint32_t i = base.find_index(Key{std::string_view(), entry.key, false});
+      if (i != empty_slot && !dropped[i])
+      {
+        dropped[i] = true;
+        arena_size -= base.offsets[base.first[i + 1]] - base.offsets[base.first[i]];
+        string_count -= base.first[i + 1] - base.first[i];
+      }
+    };
+    removed.foreach_entry(drop);
+    for(std::vector<Entry>::const_iterator i = added_entries.begin(); i != added_entries.end(); ++i)
+      drop(*i);
+
+    for(std::vector<Entry>::const_iterator i = added_entries.begin(); i != added_entries.end(); ++i)
+    {
+      has_fuzzy = has_fuzzy || i->fuzzy;
+      arena_size += i->key.size();
+      for(std::vector<std::string>::const_iterator j = i->msgstrs.begin(); j != i->msgstrs.end(); ++j)
+        arena_size += j->size();
+      if (i->fuzzy)
+      {
+        for(std::vector<std::string>::const_iterator j = i->finished.begin(); j != i->finished.end(); ++j)
+          arena_size += j->size();
+      }
+      string_count += 1 + i->msgstrs.size() + (i->fuzzy ? i->finished.size() : 0);
+    }
+  }
+
+  // a table that isn't frozen, or whose result wouldn't fit the
+  // offsets, is patched entry by entry
+  if (!base.frozen || arena_size > 0xffffffffu || string_count >= 0xffffffffu)
+  {
+    *this = base;
+    removed.foreach_entry([this](const Entry& entry) {
+      erase(Key{std::string_view(), entry.key, false});
+    });
+    for(std::vector<Entry>::iterator i = added_entries.begin(); i != added_entries.end(); ++i)
+      get(Key{std::string_view(), i->key, false}) = std::move(*i);
+    freeze();
+    return;
+  }
+
+  EntryTable result;
+  result.arena.reserve(arena_size);
+  result.offsets.reserve(string_count + 1);
+  result.first.reserve(dropped.size() + added_entries.size() + 1);
+  if (has_fuzzy)
+    result.fuzzy.reserve(dropped.size() + added_entries.size());
+
+  // copy each run of kept entries as a whole, only their offsets
+  // have to be moved
+  std::vector<uint32_t> new_index(dropped.size(), empty_slot);
+  result.offsets.push_back(0);
+  for(size_t i = 0; i < dropped.size();)
+  {
+    if (dropped[i])
+    {
+      ++i;
+      continue;
+    }
+
+    size_t end = i;
+    while (end < dropped.size() && !dropped[end])
+      ++end;
+
+    const uint32_t string_begin = base.first[i];
+    const uint32_t string_end = base.first[end];
+    const uint32_t arena_begin = base.offsets[string_begin];
+    const uint32_t new_string_begin = static_cast<uint32_t>(result.offsets.size() - 1);
+    const uint32_t new_arena_begin = static_cast<uint32_t>(result.arena.size());
+
+    result.arena.append(base.arena, arena_begin, base.offsets[string_end] - arena_begin);
+    for(uint32_t j = string_begin + 1; j <= string_end; ++j)
+      result.offsets.push_back(new_arena_begin + (base.offsets[j] - arena_begin));
+
+    for(; i < end; ++i)
+    {
+      new_index[i] = static_cast<uint32_t>(result.first.size());
+      result.first.push_back(new_string_begin + (base.first[i] - string_begin));
+      if (has_fuzzy)
+        result.fuzzy.push_back(base.fuzzy.empty() ? 0 : base.fuzzy[i]);
+    }
+  }
+
+  const uint32_t kept = static_cast<uint32_t>(result.first.size());
+  for(std::vector<Entry>::const_iterator i = added_entries.begin(); i != added_entries.end(); ++i)
+    result.append_frozen(*i, has_fuzzy);
+  result.first.push_back(static_cast<uint32_t>(result.offsets.size() - 1));
+
+  // the hashes of the kept entries are taken from the slots of base,
+  // unless it uses a perfect hash instead
+  while ((result.first.size() - 1) * 8 > result.slots.size() * 7)
+    result.grow();
+
+  const size_t mask = result.slots.size() - 1;
+  auto insert = [&result, mask](uint32_t h, uint32_t index) {
+    size_t i = h & mask;
+    while (result.slots[i].index != empty_slot)
+      i = (i + 1) & mask;
+    result.slots[i] = Slot{h, index};
+  };
+
+  if (!base.slots.empty())
+  {
+    for(std::vector<Slot>::const_iterator slot = base.slots.begin(); slot != base.slots.end(); ++slot)
+    {
+      if (slot->index != empty_slot && new_index[slot->index] != empty_slot)
+        insert(slot->hash, new_index[slot->index]);
+    }
+  }
+  else
+  {
+    for(size_t i = 0; i < new_index.size(); ++i)
+    {
+      if (new_index[i] != empty_slot)
+        insert(static_cast<uint32_t>(hash(base.get_string(base.first[i]))), new_index[i]);
+    }
+  }
+
+  for(size_t i = 0; i < added_entries.size(); ++i)
+    insert(static_cast<uint32_t>(hash(added_entries[i].key)), kept + static_cast<uint32_t>(i));
+
+  result.frozen = true;
+  *this = std::move(result);
+}
+
+void
+EntryTable::thaw()
+{
+  entries.reserve(first.size() - 1);
+  for(size_t i = 0; i + 1 < first.size(); ++i)
+  {
+    entries.push_back(get_entry(i));
+  }
+
+  std::string().swap(arena);
+  std::vector<uint32_t>().swap(offsets);
+  std::vector<uint32_t>().swap(first);
+  std::vector<uint32_t>().swap(fuzzy);
+  frozen = false;
+
+  if (!pilots.empty())
+  {
+    std::vector<uint32_t>().swap(pilots);
+    std::vector<uint32_t>().swap(remap);
+    rebuild_slots();
+  }
+}
+
+} // namespace tinygettext
+
+/* EOF */
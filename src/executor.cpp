@@ -0,0 +1,222 @@
+// tinygettext - A gettext replacement that works directly on .po files
+// Copyright (c) 2009 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgement in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+
+#include "tinygettext/executor.hpp"
+
+#include <algorithm>
+#include <exception>
+
+namespace tinygettext {
+
+namespace {
+
+/** The pool and worker index of the current thread, if it belongs to a pool */
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_index = 0;
+
+} // namespace
+
+ThreadPool::ThreadPool(unsigned int num_threads) :
+  workers(),
+  next_worker(0),
+  mutex(),
+  cond(),
+  pending(0),
+  stopping(false),
+  threads()
+{
+  if (num_threads == 0)
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+  for(unsigned int i = 0; i < num_threads; ++i)
+  {
+    workers.emplace_back(new Worker);
+  }
+
+  for(size_t i = 0; i < workers.size(); ++i)
+  {
+    threads.emplace_back(&ThreadPool::run, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  cond.notify_all();
+
+  for(std::vector<std::thread>::iterator i = threads.begin(); i != threads.end(); ++i)
+  {
+    i->join();
+  }
+}
+
+void
+ThreadPool::execute(std::function<void ()> task)
+{
+  const size_t index = (current_pool == this) ?
+    current_index :
+    next_worker.fetch_add(1) % workers.size();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending += 1;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(workers[index]->mutex);
+    workers[index]->tasks.push_back(std::move(task));
+  }
+  cond.notify_one();
+}
+
+bool
+ThreadPool::pop(size_t index, std::function<void ()>& task)
+{
+  {
+    Worker& worker = *workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (!worker.tasks.empty())
+    {
+      task = std::move(worker.tasks.back());
+      worker.tasks.pop_back();
+      return true;
+    }
+  }
+
+  for(size_t i = 1; i < workers.size(); ++i)
+  {
+    Worker& victim = *workers[(index + i) % workers.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty())
+    {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void
+ThreadPool::run(size_t index)
+{
+  current_pool = this;
+  current_index = index;
+
+  for(;;)
+  {
+    std::function<void ()> task;
+    if (pop(index, task))
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending -= 1;
+      }
+      task();
+    }
+    else
+    {
+      // pending is counted before the task is queued, so it might
+      // briefly be set while there is nothing to pop yet
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait(lock, [this]{ return stopping || pending != 0; });
+      if (stopping && pending == 0)
+        return;
+    }
+  }
+}
+
+namespace {
+
+struct ParallelFor
+{
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::vector<bool> claimed;
+  size_t remaining;
+  std::exception_ptr error;
+
+  ParallelFor(size_t count) :
+    mutex(), cond(), claimed(count, false), remaining(count), error()
+  {}
+
+  /** Runs call \a i unless somebody else already took it, \a func
+      is only touched when the call is actually made, so tasks that
+      run after parallel_for() returned are harmless */
+  void run(size_t i, const std::function<void (size_t)>& func)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (claimed[i])
+        return;
+      claimed[i] = true;
+    }
+
+    std::exception_ptr err;
+    try
+    {
+      func(i);
+    }
+    catch(...)
+    {
+      err = std::current_exception();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (err && !error)
+        error = err;
+      remaining -= 1;
+    }
+    cond.notify_all();
+  }
+};
+
+} // namespace
+
+void
+parallel_for(Executor& executor, size_t count, const std::function<void (size_t)>& func)
+{
+  std::shared_ptr<ParallelFor> state = std::make_shared<ParallelFor>(count);
+
+  // the caller takes the first one itself
+  for(size_t i = 1; i < count; ++i)
+  {
+    executor.execute([state, &func, i]{ state->run(i, func); });
+  }
+
+  for(size_t i = 0; i < count; ++i)
+  {
+    state->run(i, func);
+  }
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->cond.wait(lock, [&state]{ return state->remaining == 0; });
+  if (state->error)
+    std::rethrow_exception(state->error);
+}
+
+} // namespace tinygettext
+
+/* EOF */
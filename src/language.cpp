@@ -20,6 +20,7 @@
 #include "tinygettext/language.hpp"
 
 #include <assert.h>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 #include <algorithm>
@@ -298,8 +299,9 @@ resolve_language_alias(const std::string& name)
 {
   typedef std::unordered_map<std::string, std::string> Aliases;
   static Aliases language_aliases;
-  if (language_aliases.empty())
-  {
+  static std::once_flag language_aliases_init;
+  // dictionaries may be loaded from several threads at once
+  std::call_once(language_aliases_init, []() {
     // FIXME: Many of those are not useful for us, since we leave
     // encoding to the app, not to the language, we could/should
     // also match against all language names, not just aliases from
@@ -353,7 +355,7 @@ resolve_language_alias(const std::string& name)
     language_aliases["swedish"]          = "sv_SE.ISO-8859-1";
     language_aliases["thai"]             = "th_TH.TIS-620";
     language_aliases["turkish"]          = "tr_TR.ISO-8859-9";
-  }
+  });
 
   std::string name_lowercase;
   name_lowercase.resize(name.size());
@@ -378,12 +380,12 @@ Language::from_spec(const std::string& language, const std::string& country, con
 {
   typedef std::unordered_map<std::string, std::vector<const LanguageSpec*> > LanguageSpecMap;
   static LanguageSpecMap language_map;
+  static std::once_flag language_map_init;
 
-  if (language_map.empty())
-  { // Init language_map
+  std::call_once(language_map_init, []() { // Init language_map
     for(int i = 0; languages[i].language != nullptr; ++i)
       language_map[languages[i].language].push_back(&languages[i]);
-  }
+  });
 
   LanguageSpecMap::iterator i = language_map.find(language);
   if (i != language_map.end())
@@ -0,0 +1,177 @@
+// tinygettext - A gettext replacement that works directly on .po files
+// Copyright (c) 2009 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgement in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "tinygettext/miss_tracker.hpp"
+
+#include <algorithm>
+#include <ctime>
+#include <functional>
+#include <ostream>
+
+namespace tinygettext {
+
+namespace {
+
+void write_string(std::ostream& out, const std::string& str)
+{
+  out << '"';
+  for(std::string::const_iterator i = str.begin(); i != str.end(); ++i)
+  {
+    switch (*i)
+    {
+      case '\a': out << "\\a"; break;
+      case '\b': out << "\\b"; break;
+      case '\v': out << "\\v"; break;
+      case '\n': out << "\\n"; break;
+      case '\t': out << "\\t"; break;
+      case '\r': out << "\\r"; break;
+      case '"':  out << "\\\""; break;
+      case '\\': out << "\\\\"; break;
+      default:   out << *i; break;
+    }
+  }
+  out << '"';
+}
+
+} // namespace
+
+MissTracker::MissTracker() :
+  shards()
+{
+}
+
+void
+MissTracker::record(std::optional<std::string_view> msgctxt,
+                    std::string_view msgid, std::string_view msgid_plural)
+{
+  // reused between calls, so repeated misses don't allocate
+  thread_local std::string key;
+  key.clear();
+  if (msgctxt)
+  {
+    key += *msgctxt;
+    key += '\x04';
+  }
+  key += msgid;
+
+  Shard& shard = shards[std::hash<std::string>()(key) % shard_count];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  std::unordered_map<std::string, Miss>::iterator it = shard.misses.find(key);
+  if (it == shard.misses.end())
+  {
+    Miss miss{static_cast<bool>(msgctxt),
+              msgctxt ? std::string(*msgctxt) : std::string(),
+              std::string(msgid),
+              std::string(msgid_plural),
+              0,
+              std::chrono::system_clock::now()};
+    it = shard.misses.emplace(key, std::move(miss)).first;
+  }
+  it->second.count += 1;
+}
+
+std::vector<MissTracker::Miss>
+MissTracker::get_misses() const
+{
+  std::vector<Miss> result;
+  for(size_t i = 0; i < shard_count; ++i)
+  {
+    std::lock_guard<std::mutex> lock(shards[i].mutex);
+    for(std::unordered_map<std::string, Miss>::const_iterator it = shards[i].misses.begin();
+        it != shards[i].misses.end(); ++it)
+    {
+      result.push_back(it->second);
+    }
+  }
+
+  std::stable_sort(result.begin(), result.end(),
+                   [](const Miss& lhs, const Miss& rhs) {
+                     return lhs.first_seen < rhs.first_seen;
+                   });
+  return result;
+}
+
+size_t
+MissTracker::size() const
+{
+  size_t result = 0;
+  for(size_t i = 0; i < shard_count; ++i)
+  {
+    std::lock_guard<std::mutex> lock(shards[i].mutex);
+    result += shards[i].misses.size();
+  }
+  return result;
+}
+
+void
+MissTracker::clear()
+{
+  for(size_t i = 0; i < shard_count; ++i)
+  {
+    std::lock_guard<std::mutex> lock(shards[i].mutex);
+    shards[i].misses.clear();
+  }
+}
+
+void
+MissTracker::write_pot(std::ostream& out) const
+{
+  std::vector<Miss> misses = get_misses();
+  for(std::vector<Miss>::const_iterator i = misses.begin(); i != misses.end(); ++i)
+  {
+    std::time_t first_seen = std::chrono::system_clock::to_time_t(i->first_seen);
+    std::tm tm;
+#ifdef _WIN32
+    gmtime_s(&tm, &first_seen);
+#else
+    gmtime_r(&first_seen, &tm);
+#endif
+    char timestamp[32];
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%SZ", &tm);
+
+    out << "#. missed " << i->count << " times, first seen " << timestamp << "\n";
+    if (i->has_msgctxt)
+    {
+      out << "msgctxt ";
+      write_string(out, i->msgctxt);
+      out << "\n";
+    }
+    out << "msgid ";
+    write_string(out, i->msgid);
+    out << "\n";
+    if (i->msgid_plural.empty())
+    {
+      out << "msgstr \"\"\n";
+    }
+    else
+    {
+      out << "msgid_plural ";
+      write_string(out, i->msgid_plural);
+      out << "\n";
+      out << "msgstr[0] \"\"\n";
+      out << "msgstr[1] \"\"\n";
+    }
+    out << "\n";
+  }
+}
+
+} // namespace tinygettext
+
+/* EOF */
@@ -19,6 +19,7 @@
 
 #include "tinygettext/plural_forms.hpp"
 
+#include <mutex>
 #include <unordered_map>
 
 namespace tinygettext {
@@ -66,9 +67,9 @@ PluralForms::from_string(const std::string& str)
 {
   typedef std::unordered_map<std::string, PluralForms> PluralFormsMap;
   static PluralFormsMap plural_forms;
+  static std::once_flag plural_forms_init;
 
-  if (plural_forms.empty())
-  {
+  std::call_once(plural_forms_init, []() {
     // Note that the plural forms here shouldn't contain any spaces
     plural_forms["Plural-Forms:nplurals=1;plural=0;"] = PluralForms(1, plural1);
     plural_forms["Plural-Forms:nplurals=2;plural=(n!=1);"] = PluralForms(2, plural2_1);
@@ -95,7 +96,7 @@ PluralForms::from_string(const std::string& str)
     plural_forms["Plural-Forms:nplurals=4;plural=(n==1&&n%1==0)?0:(n==2&&n%1==0)?1:(n%10==0&&n%1==0&&n>10)?2:3;"] = PluralForms(4, plural4_he);
     plural_forms["Plural-Forms:nplurals=5;plural=(n==1?0:n==2?1:n<7?2:n<11?3:4)"] = PluralForms(5, plural5_ga);
     plural_forms["Plural-Forms:nplurals=6;plural=n==0?0:n==1?1:n==2?2:n%100>=3&&n%100<=10?3:n%100>=11?4:5"]=PluralForms(6, plural6_ar);
-  }
+  });
 
   // Remove spaces from string before lookup
   std::string space_less_str;
@@ -0,0 +1,308 @@
+// tinygettext - A gettext replacement that works directly on .po files
+// Copyright (c) 2009 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgement in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "tinygettext/po_block_index.hpp"
+
+#include <algorithm>
+#include <ctype.h>
+#include <limits.h>
+#include <string.h>
+
+namespace tinygettext {
+
+namespace {
+
+const std::string_view header_key = "msgid \"\"\n";
+
+const uint64_t fnv_offset = 14695981039346656037ull;
+
+// FNV-1a
+uint64_t hash(uint64_t h, std::string_view text)
+{
+  for(std::string_view::const_iterator i = text.begin(); i != text.end(); ++i)
+  {
+    h ^= static_cast<unsigned char>(*i);
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+/** Hash of a whole block, taking 8 bytes at a time, this only has to
+    notice changes, not to spread keys over a table */
+uint64_t hash_block(std::string_view text)
+{
+  uint64_t h = fnv_offset ^ text.size();
+  size_t i = 0;
+  for(; i + 8 <= text.size(); i += 8)
+  {
+    uint64_t word;
+    memcpy(&word, text.data() + i, 8);
+    h = (h ^ word) * 0x9e3779b97f4a7c15ull;
+    h ^= h >> 32;
+  }
+  return hash(h, text.substr(i));
+}
+
+bool has_prefix(std::string_view line, std::string_view prefix)
+{
+  return line.compare(0, prefix.size(), prefix) == 0;
+}
+
+bool is_blank(std::string_view line)
+{
+  for(std::string_view::const_iterator i = line.begin(); i != line.end(); ++i)
+  {
+    if (!isspace(static_cast<unsigned char>(*i)))
+      return false;
+  }
+  return true;
+}
+
+/** Append \a block to \a out, followed by the empty line that ends
+    an entry */
+void append_block(std::string& out, std::string_view block)
+{
+  out += block;
+  if (!block.empty() && block.back() != '\n')
+    out += '\n';
+  out += '\n';
+}
+
+/** Like append_block(), but remember where the block came from, \a
+    lines is the number of lines in \a out so far */
+void append_block(POBlockIndex::Diff& diff, int& lines, std::string_view block, int line)
+{
+  const size_t start = diff.changed.size();
+  diff.changed_lines.push_back(std::make_pair(lines + 1, line));
+  append_block(diff.changed, block);
+  lines += static_cast<int>(std::count(diff.changed.begin() + start, diff.changed.end(), '\n'));
+}
+
+void append_key(std::string& out, std::string_view key)
+{
+  out += key;
+  out += "msgstr \"-\"\n\n";
+}
+
+} // namespace
+
+POBlockIndex::POBlockIndex() :
+  has_header(false),
+  header(),
+  blocks(),
+  keys()
+{
+}
+
+bool
+POBlockIndex::build(std::string_view text)
+{
+  has_header = false;
+  blocks.clear();
+  keys.clear();
+
+  size_t pos = 0;
+
+  // the parser skips an UTF-8 byte order mark as well
+  if (has_prefix(text, "\xef\xbb\xbf"))
+    pos = 3;
+
+  size_t block_start = std::string_view::npos;
+  int line_number = 0;
+  int block_line = 0;
+  size_t key_start = 0;
+  uint64_t key_hash = fnv_offset;
+  bool in_key = false;
+  bool seen_msgstr = false;
+
+  auto finish = [&](size_t block_end) {
+    if (block_start != std::string_view::npos)
+    {
+      const std::string_view block = text.substr(block_start, block_end - block_start);
+      const Block entry = { key_hash, hash_block(block), block_start, block.size(), block_line,
+                            key_start, keys.size() - key_start };
+
+      // blocks without a msgid only hold comments or obsolete entries
+      if (get_key(entry) == header_key)
+      {
+        if (has_header)
+          return false;
+        header = entry;
+        has_header = true;
+        keys.resize(key_start);
+      }
+      else if (entry.key_length > 0)
+      {
+        blocks.push_back(entry);
+      }
+    }
+
+    block_start = std::string_view::npos;
+    key_start = keys.size();
+    key_hash = fnv_offset;
+    in_key = false;
+    seen_msgstr = false;
+    return true;
+  };
+
+  while (pos < text.size())
+  {
+    size_t eol = text.find('\n', pos);
+    if (eol == std::string_view::npos)
+      eol = text.size();
+
+    std::string_view line = text.substr(pos, eol - pos);
+    if (!line.empty() && line.back() == '\r')
+      line.remove_suffix(1);
+    line_number += 1;
+
+    if (is_blank(line))
+    {
+      if (!finish(pos))
+        return false;
+    }
+    else
+    {
+      // the parser needs an empty line after each entry and skips
+      // what follows otherwise, that isn't worth reproducing here
+      if (seen_msgstr && line[0] != '"' && !has_prefix(line, "msgstr"))
+        return false;
+
+      if (block_start == std::string_view::npos)
+      {
+        block_start = pos;
+        block_line = line_number;
+      }
+
+      if (has_prefix(line, "msgctxt") ||
+          (has_prefix(line, "msgid") && !has_prefix(line, "msgid_plural")))
+      {
+        in_key = true;
+      }
+      else if (line[0] != '"')
+      {
+        in_key = false;
+        if (has_prefix(line, "msgstr"))
+          seen_msgstr = true;
+      }
+
+      if (in_key)
+      {
+        keys += line;
+        keys += '\n';
+        key_hash = hash(hash(key_hash, line), "\n");
+      }
+    }
+
+    pos = eol + 1;
+  }
+
+  if (!finish(text.size()))
+    return false;
+
+  std::sort(blocks.begin(), blocks.end(), [](const Block& lhs, const Block& rhs) {
+    return lhs.key_hash < rhs.key_hash;
+  });
+
+  // an entry that is there twice can't be told apart from its
+  // duplicate, neither can two keys with the same hash
+  for(size_t i = 1; i < blocks.size(); ++i)
+  {
+    if (blocks[i - 1].key_hash == blocks[i].key_hash)
+      return false;
+  }
+
+  return true;
+}
+
+bool
+POBlockIndex::diff(const POBlockIndex& old, std::string_view text, Diff& result) const
+{
+  if (!has_header || !old.has_header || header.hash != old.header.hash)
+    return false;
+
+  result.changed.clear();
+  result.removed.clear();
+  result.changed_lines.clear();
+
+  // the header is needed to get the charset and plural forms right
+  int lines = 0;
+  append_block(result, lines, text.substr(header.offset, header.length), header.line);
+  result.removed = result.changed;
+
+  // the changed blocks are put in file order, so that their
+  // diagnostics come in the same order as with a full parse
+  std::vector<const Block*> changed;
+
+  std::vector<Block>::const_iterator i = blocks.begin();
+  std::vector<Block>::const_iterator j = old.blocks.begin();
+  while (i != blocks.end() || j != old.blocks.end())
+  {
+    if (j == old.blocks.end() || (i != blocks.end() && i->key_hash < j->key_hash))
+    {
+      // added
+      changed.push_back(&*i);
+      ++i;
+    }
+    else if (i == blocks.end() || j->key_hash < i->key_hash)
+    {
+      // removed
+      append_key(result.removed, old.get_key(*j));
+      ++j;
+    }
+    else
+    {
+      // the new version might not add a translation at all, so a
+      // modified entry is removed first
+      if (i->hash != j->hash || get_key(*i) != old.get_key(*j))
+      {
+        changed.push_back(&*i);
+        append_key(result.removed, old.get_key(*j));
+      }
+      ++i;
+      ++j;
+    }
+  }
+
+  std::sort(changed.begin(), changed.end(), [](const Block* lhs, const Block* rhs) {
+    return lhs->offset < rhs->offset;
+  });
+  for(std::vector<const Block*>::const_iterator c = changed.begin(); c != changed.end(); ++c)
+  {
+    append_block(result, lines, text.substr((*c)->offset, (*c)->length), (*c)->line);
+  }
+
+  return true;
+}
+
+int
+POBlockIndex::Diff::file_line(int line) const
+{
+  std::vector<std::pair<int, int> >::const_iterator it =
+    std::upper_bound(changed_lines.begin(), changed_lines.end(), std::make_pair(line, INT_MAX));
+  if (it == changed_lines.begin())
+    return line;
+
+  --it;
+  return line - it->first + it->second;
+}
+
+} // namespace tinygettext
+
+/* EOF */
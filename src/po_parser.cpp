@@ -19,36 +19,306 @@
 
 #include "tinygettext/po_parser.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <ctype.h>
+#include <memory>
 #include <string>
 #include <istream>
 #include <string.h>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <stdlib.h>
 
 #include "tinygettext/language.hpp"
 #include "tinygettext/log_stream.hpp"
 #include "tinygettext/iconv.hpp"
 #include "tinygettext/dictionary.hpp"
+#include "tinygettext/executor.hpp"
 #include "tinygettext/plural_forms.hpp"
 
 namespace tinygettext {
 
 bool POParser::pedantic = true;
+std::string POParser::scanner_implementation;
+const size_t POParser::min_chunk_size = 256 * 1024;
+
+namespace {
+
+POScanner make_scanner()
+{
+  if (POParser::scanner_implementation.empty())
+    return POScanner();
+  else
+    return POScanner(POParser::scanner_implementation);
+}
+
+/** Returns the start of the first line at or after \a pos that is
+    blank, i.e. only consists of whitespace, if \a blank is set, or
+    the first one that isn't otherwise, npos if there is none */
+std::string_view::size_type find_line(std::string_view data, std::string_view::size_type pos,
+                                      bool blank, const POScanner& scanner)
+{
+  const char* const end = data.data() + data.size();
+  while(pos < data.size())
+  {
+    const char* const line = data.data() + pos;
+    const char* const line_end = scanner.find_newline(line, end);
+    if ((scanner.skip_space(line, line_end) == line_end) == blank)
+      return pos;
+    pos = static_cast<std::string_view::size_type>(line_end - data.data()) + 1;
+  }
+  return std::string_view::npos;
+}
+
+/** Returns the start of the line following the one at \a pos */
+std::string_view::size_type next_line_start(std::string_view data, std::string_view::size_type pos,
+                                            const POScanner& scanner)
+{
+  const char* const end = data.data() + data.size();
+  const char* const line_end = scanner.find_newline(data.data() + pos, end);
+  if (line_end == end)
+    return data.size();
+  else
+    return static_cast<std::string_view::size_type>(line_end - data.data()) + 1;
+}
+
+/** Quote a translation for a diagnostic, plural forms in brackets,
+    only the first one if it was replaced by one without plural forms */
+std::string format_msgstrs(const std::vector<std::string>& msgstrs, bool singular)
+{
+  if (singular || msgstrs.size() == 1)
+    return "'" + msgstrs[0] + "'";
+
+  std::string result = "[";
+  for(std::vector<std::string>::const_iterator i = msgstrs.begin(); i != msgstrs.end(); ++i)
+  {
+    if (i != msgstrs.begin())
+      result += ", ";
+    result += "'" + *i + "'";
+  }
+  return result + "]";
+}
+
+int count_lines(std::string_view text, const POScanner& scanner)
+{
+  int lines = 0;
+  const char* const end = text.data() + text.size();
+  for(const char* p = scanner.find_newline(text.data(), end); p != end; p = scanner.find_newline(p + 1, end))
+    lines += 1;
+  return lines;
+}
+
+} // namespace
+
+void
+POParser::parse(const std::string& filename, std::istream& in, Dictionary& dict,
+                std::vector<PODiagnostic>* diagnostics)
+{
+  POParser parser(filename, dict, diagnostics);
+  char buffer[64 * 1024];
+  while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0)
+    parser.feed(std::string_view(buffer, static_cast<std::string_view::size_type>(in.gcount())));
+  parser.finish();
+}
 
 void
-POParser::parse(const std::string& filename, std::istream& in, Dictionary& dict)
+POParser::parse(const std::string& filename, std::string_view data, Dictionary& dict,
+                std::vector<PODiagnostic>* diagnostics)
 {
-  POParser parser(filename, in, dict);
+  POParser parser(filename, data, dict);
+  parser.diagnostics = diagnostics;
   parser.parse();
 }
 
-class POParserError {};
+void
+POParser::parse(const std::string& filename, std::string_view data, Dictionary& dict,
+                Executor& executor, size_t num_chunks,
+                std::vector<PODiagnostic>* diagnostics)
+{
+  if (num_chunks == 0)
+  {
+    const size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+    num_chunks = std::min(num_threads, data.size() / min_chunk_size);
+  }
 
-POParser::POParser(const std::string& filename_, std::istream& in_, Dictionary& dict_, bool use_fuzzy_) :
+  if (num_chunks <= 1)
+  {
+    parse(filename, data, dict, diagnostics);
+    return;
+  }
+
+  const POScanner scanner = make_scanner();
+
+  // the header sets the charset and the Plural-Forms, so it is parsed
+  // first, up to the first blank line after it
+  std::string_view::size_type boundary = find_line(data, 0, false, scanner);
+  if (boundary != std::string_view::npos)
+    boundary = find_line(data, boundary, true, scanner);
+
+  if (boundary == std::string_view::npos)
+  {
+    parse(filename, data, dict, diagnostics);
+    return;
+  }
+
+  POParser header_parser(filename, data.substr(0, next_line_start(data, boundary, scanner)), dict);
+  header_parser.diagnostics = diagnostics;
+  header_parser.parse();
+
+  if (!header_parser.has_header)
+  {
+    // without a header there is nothing to hand on to the chunks, the
+    // rest is parsed in one go
+    POParser parser(filename, data.substr(boundary), dict);
+    parser.diagnostics = diagnostics;
+    parser.line_number = count_lines(data.substr(0, boundary), scanner);
+    parser.parse_chunk(header_parser.eof_in_recovery);
+    return;
+  }
+
+  // Each chunk starts with a blank line between two entries and ends
+  // with the blank line the next chunk starts with. That line is
+  // where a sequential parse would resume after an error in the last
+  // entry of the chunk, unless the error happened on the blank line
+  // itself, in which case the next chunk has to be parsed again
+  // starting with the recovery.
+  struct Chunk
+  {
+    std::string_view::size_type begin;
+    std::string_view::size_type end;
+    int num_lines;
+    std::unique_ptr<Dictionary> dict;
+    std::vector<PODiagnostic> diagnostics;
+    bool eof_in_recovery;
+    std::vector<EntrySource> entry_sources[2];
+    std::unordered_map<std::string, std::vector<std::string> > first_msgstrs;
+    std::unordered_set<std::string> plural_duplicates;
+  };
+
+  std::vector<Chunk> chunks;
+  chunks.push_back(Chunk{boundary, 0, 0, {}, {}, false, {}, {}, {}});
+  for(size_t i = 1; i < num_chunks; ++i)
+  {
+    const std::string_view::size_type target = boundary + (data.size() - boundary) / num_chunks * i;
+    if (target > chunks.back().begin)
+    {
+      const std::string_view::size_type begin = find_line(data, next_line_start(data, target, scanner), true, scanner);
+      if (begin == std::string_view::npos)
+        break;
+      chunks.push_back(Chunk{begin, 0, 0, {}, {}, false, {}, {}, {}});
+    }
+  }
+
+  for(size_t i = 0; i < chunks.size(); ++i)
+  {
+    if (i + 1 < chunks.size())
+    {
+      chunks[i].end = next_line_start(data, chunks[i + 1].begin, scanner);
+      chunks[i].num_lines = count_lines(data.substr(chunks[i].begin, chunks[i + 1].begin - chunks[i].begin), scanner);
+    }
+    else
+    {
+      chunks[i].end = data.size();
+    }
+  }
+
+  auto parse_chunk = [&filename, &data, &dict, &header_parser](Chunk& chunk, bool recovering) {
+    chunk.dict.reset(new Dictionary(dict.get_charset()));
+    chunk.dict->set_plural_forms(dict.get_plural_forms());
+
+    chunk.diagnostics.clear();
+
+    POParser parser(filename, data.substr(chunk.begin, chunk.end - chunk.begin), *chunk.dict);
+    parser.diagnostics = &chunk.diagnostics;
+    parser.big5 = header_parser.big5;
+    parser.conv.set_charsets(header_parser.header_charset, dict.get_charset());
+    parser.track_sources = true;
+    parser.parse_chunk(recovering);
+
+    chunk.eof_in_recovery = parser.eof_in_recovery;
+    chunk.entry_sources[0] = std::move(parser.entry_sources[0]);
+    chunk.entry_sources[1] = std::move(parser.entry_sources[1]);
+    chunk.first_msgstrs = std::move(parser.first_msgstrs);
+    chunk.plural_duplicates = std::move(parser.plural_duplicates);
+  };
+
+  parallel_for(executor, chunks.size(), [&chunks, &parse_chunk](size_t i) {
+    parse_chunk(chunks[i], false);
+  });
+
+  // merge in file order, so that later entries win just as they would
+  // when parsed one after another
+  int first_line = count_lines(data.substr(0, boundary), scanner);
+  bool recovering = header_parser.eof_in_recovery;
+  for(std::vector<Chunk>::iterator i = chunks.begin(); i != chunks.end(); ++i)
+  {
+    if (recovering)
+      parse_chunk(*i, true);
+
+    // an entry replacing one of an earlier chunk is reported at its
+    // first occurrence in this chunk, among the chunk's own
+    // diagnostics where a sequential parse would have reported it
+    std::vector<std::pair<size_t, PODiagnostic> > duplicates;
+    dict.merge(std::move(*i->dict), [&filename, &i, &duplicates](const EntryTable::Entry& entry,
+                                                                 EntryTable::Entry& other_entry,
+                                                                 bool has_ctxt, size_t index) {
+      const EntrySource& source = i->entry_sources[has_ctxt ? 1 : 0][index];
+      std::unordered_map<std::string, std::vector<std::string> >::const_iterator first =
+        i->first_msgstrs.find(other_entry.key);
+      const std::vector<std::string>& msgstrs = (first != i->first_msgstrs.end()) ? first->second : other_entry.msgstrs;
+      if (source.singular ? msgstrs[0] != entry.msgstrs[0] : msgstrs != entry.msgstrs)
+      {
+        duplicates.push_back(std::make_pair(source.diagnostic,
+                                            PODiagnostic{filename, source.line, PODiagnostic::DUPLICATE_ENTRY, false,
+                                                         "duplicate entry, replaces " +
+                                                         format_msgstrs(entry.msgstrs, source.singular),
+                                                         std::string(source.text)}));
+      }
+
+      // translations without plural forms only replace the first one,
+      // unless the chunk has one with plural forms as well
+      if (source.singular && entry.msgstrs.size() > 1 && !i->plural_duplicates.count(other_entry.key))
+      {
+        other_entry.msgstrs.insert(other_entry.msgstrs.end(), entry.msgstrs.begin() + 1, entry.msgstrs.end());
+        if (other_entry.finished.size() == 1)
+          other_entry.finished.insert(other_entry.finished.end(), entry.msgstrs.begin() + 1, entry.msgstrs.end());
+      }
+    });
+    std::sort(duplicates.begin(), duplicates.end(),
+              [](const std::pair<size_t, PODiagnostic>& lhs, const std::pair<size_t, PODiagnostic>& rhs) {
+                return (lhs.first < rhs.first ||
+                        (lhs.first == rhs.first && lhs.second.line_number < rhs.second.line_number));
+              });
+
+    // the chunks count lines from their start
+    auto report_diagnostic = [&diagnostics, first_line](PODiagnostic& diagnostic) {
+      diagnostic.line_number += first_line;
+      if (diagnostics)
+        diagnostics->push_back(std::move(diagnostic));
+      else
+        log(diagnostic);
+    };
+
+    std::vector<std::pair<size_t, PODiagnostic> >::iterator duplicate = duplicates.begin();
+    for(size_t n = 0; n <= i->diagnostics.size(); ++n)
+    {
+      for(; duplicate != duplicates.end() && duplicate->first == n; ++duplicate)
+        report_diagnostic(duplicate->second);
+      if (n < i->diagnostics.size())
+        report_diagnostic(i->diagnostics[n]);
+    }
+
+    recovering = i->eof_in_recovery;
+    first_line += i->num_lines;
+  }
+}
+
+POParser::POParser(const std::string& filename_, std::string_view data_, Dictionary& dict_, bool use_fuzzy_) :
   filename(filename_),
-  in(in_),
+  data(data_),
+  pos(0),
   dict(dict_),
   use_fuzzy(use_fuzzy_),
   running(false),
@@ -56,139 +326,421 @@ POParser::POParser(const std::string& filename_, std::istream& in_, Dictionary&
   big5(false),
   line_number(0),
   current_line(),
-  conv()
+  has_header(false),
+  header_charset(),
+  eof_in_recovery(false),
+  failed(false),
+  diagnostics(nullptr),
+  conv(),
+  scanner(make_scanner()),
+  msgctxt_buffer(),
+  msgid_buffer(),
+  msgid_plural_buffer(),
+  msgstr_buffer(),
+  convert_buffer(),
+  msgstrs_buffer(),
+  track_sources(false),
+  entry_sources(),
+  first_msgstrs(),
+  plural_duplicates(),
+  pending(),
+  pending_first_line(0),
+  pending_lines(0),
+  pending_line_start(0),
+  pending_line_blank(true),
+  started(false)
 {
 }
 
+POParser::POParser(const std::string& filename_, Dictionary& dict_,
+                   std::vector<PODiagnostic>* diagnostics_) :
+  POParser(filename_, std::string_view(), dict_)
+{
+  diagnostics = diagnostics_;
+}
+
 POParser::~POParser()
 {
 }
 
 void
-POParser::warning(const std::string& msg)
+POParser::feed(std::string_view bytes)
+{
+  const std::string::size_type scan_pos = pending.size();
+  pending.append(bytes.data(), bytes.size());
+
+  // Look for the last complete blank line in the new data. A blank
+  // line ends every entry, so everything up to it can be parsed, just
+  // like a chunk in the parallel parse(), and the rest has to wait.
+  std::string::size_type cut = std::string::npos;
+  int cut_lines = 0;
+  const char* const end = pending.data() + pending.size();
+  const char* line = pending.data() + scan_pos;
+  for(;;)
+  {
+    const char* const line_end = scanner.find_newline(line, end);
+    if (pending_line_blank)
+      pending_line_blank = scanner.skip_space(line, line_end) == line_end;
+
+    if (line_end == end)
+      break;
+
+    if (pending_line_blank)
+    {
+      cut = pending_line_start;
+      cut_lines = pending_lines;
+    }
+
+    line = line_end + 1;
+    pending_lines += 1;
+    pending_line_start = static_cast<std::string::size_type>(line - pending.data());
+    pending_line_blank = true;
+  }
+
+  if (cut != std::string::npos)
+  {
+    parse_pending(std::string_view(pending).substr(0, next_line_start(pending, cut, scanner)));
+
+    // the blank line is kept, the next piece starts with it
+    pending.erase(0, cut);
+    pending_first_line += cut_lines;
+    pending_lines -= cut_lines;
+    pending_line_start -= cut;
+  }
+}
+
+void
+POParser::finish()
 {
-  log_warning << filename << ":" << line_number << ": warning: " << msg << ": " << current_line << std::endl;
-  //log_warning << "Line: " << current_line << std::endl;
+  parse_pending(pending);
+
+  pending.clear();
+  pending.shrink_to_fit();
 }
 
 void
-POParser::error(const std::string& msg)
+POParser::parse_pending(std::string_view block)
 {
-  log_error << filename << ":" << line_number << ": error: " << msg  << ": " << current_line << std::endl;
+  data = block;
+  pos = 0;
+  eof = false;
+  line_number = pending_first_line;
 
+  if (!started)
+  {
+    started = true;
+    parse();
+  }
+  else
+  {
+    const bool recovering = eof_in_recovery;
+    eof_in_recovery = false;
+    parse_chunk(recovering);
+  }
+
+  data = std::string_view();
+}
+
+void
+POParser::warning(PODiagnostic::Code code, const std::string& msg)
+{
+  report(code, false, msg);
+}
+
+void
+POParser::error(PODiagnostic::Code code, const std::string& msg)
+{
+  report(code, true, msg);
+
+  recover();
+
+  failed = true;
+}
+
+void
+POParser::report(PODiagnostic::Code code, bool error_, const std::string& msg)
+{
+  report(code, error_, msg, line_number, current_line);
+}
+
+void
+POParser::report(PODiagnostic::Code code, bool error_, const std::string& msg,
+                 int at_line, std::string_view at_text)
+{
+  PODiagnostic diagnostic{filename, at_line, code, error_, msg, std::string(at_text)};
+  if (diagnostics)
+    diagnostics->push_back(std::move(diagnostic));
+  else
+    log(diagnostic);
+}
+
+void
+POParser::add_translation(std::optional<std::string_view> msgctxt, std::string_view msgid,
+                          std::vector<std::string>& msgstrs, bool singular, bool fuzzy,
+                          int msgid_line, std::string_view msgid_text)
+{
+  if (dict.store_translation(msgctxt, msgid, msgstrs, fuzzy, singular))
+  {
+    report(PODiagnostic::DUPLICATE_ENTRY, false, "duplicate entry, replaces " + format_msgstrs(msgstrs, singular),
+           msgid_line, msgid_text);
+  }
+
+  if (track_sources)
+  {
+    if (msgstrs.empty())
+    {
+      entry_sources[msgctxt ? 1 : 0].push_back(EntrySource{msgid_line, msgid_text,
+                                                            diagnostics ? diagnostics->size() : 0, singular});
+    }
+    else
+    {
+      std::string key;
+      if (msgctxt)
+      {
+        key += *msgctxt;
+        key += EntryTable::ctxt_separator;
+      }
+      key += msgid;
+      if (!singular)
+        plural_duplicates.insert(key);
+      first_msgstrs.emplace(std::move(key), std::move(msgstrs));
+    }
+  }
+}
+
+void
+POParser::recover()
+{
   // Try to recover from an error by searching for start of another entry
   do
     next_line();
   while(!eof && !is_empty_line());
 
-  throw POParserError();
+  eof_in_recovery = eof;
+}
+
+void
+POParser::log(const PODiagnostic& diagnostic)
+{
+  if (diagnostic.error)
+  {
+    log_error << diagnostic.filename << ":" << diagnostic.line_number << ": error: "
+              << diagnostic.message << ": " << diagnostic.line << std::endl;
+  }
+  else
+  {
+    log_warning << diagnostic.filename << ":" << diagnostic.line_number << ": warning: "
+                << diagnostic.message << ": " << diagnostic.line << std::endl;
+  }
 }
 
 void
 POParser::next_line()
 {
   line_number += 1;
-  if (!std::getline(in, current_line))
+  if (pos >= data.size())
+  {
+    current_line = std::string_view();
     eof = true;
+  }
+  else
+  {
+    const char* start = data.data() + pos;
+    const char* end = scanner.find_newline(start, data.data() + data.size());
+    if (end != data.data() + data.size())
+    {
+      current_line = std::string_view(start, static_cast<std::string_view::size_type>(end - start));
+      pos += current_line.size() + 1;
+    }
+    else
+    {
+      current_line = data.substr(pos);
+      pos = data.size();
+    }
+  }
 }
 
-void
-POParser::get_string_line(std::ostringstream& out, size_t skip)
+std::string_view
+POParser::get_string_line(size_t skip, bool& escaped)
 {
-  if (skip+1 >= static_cast<unsigned int>(current_line.size()))
-    error("unexpected end of line");
+  if (skip+1 >= current_line.size())
+  {
+    error(PODiagnostic::UNEXPECTED_END_OF_LINE, "unexpected end of line");
+    return std::string_view();
+  }
 
   if (current_line[skip] != '"')
-    error("expected start of string '\"'");
-
-  std::string::size_type i;
-  for(i = skip+1; current_line[i] != '\"'; ++i)
   {
-    if (big5 && static_cast<unsigned char>(current_line[i]) >= 0x81 && static_cast<unsigned char>(current_line[i]) <= 0xfe)
-    {
-      out << current_line[i];
+    error(PODiagnostic::EXPECTED_STRING, "expected start of string '\"'");
+    return std::string_view();
+  }
 
-      i += 1;
+  escaped = false;
 
-      if (i >= current_line.size())
-        error("invalid big5 encoding");
+  const char* const line_begin = current_line.data();
+  const char* const line_end = line_begin + current_line.size();
+
+  std::string_view::size_type i;
+  for(i = skip+1; i < current_line.size(); ++i)
+  {
+    // skip over the bytes that need no special handling
+    i = static_cast<std::string_view::size_type>(
+      scanner.find_string_special(line_begin + i, line_end, big5) - line_begin);
 
-      out << current_line[i];
+    if (i >= current_line.size() || current_line[i] == '\"')
+    {
+      break;
     }
-    else if (i >= current_line.size())
+    else if (big5 && static_cast<unsigned char>(current_line[i]) >= 0x81 && static_cast<unsigned char>(current_line[i]) <= 0xfe)
     {
-      error("unexpected end of string");
+      i += 1;
+
+      if (i >= current_line.size())
+      {
+        error(PODiagnostic::INVALID_BIG5, "invalid big5 encoding");
+        return std::string_view();
+      }
     }
     else if (current_line[i] == '\\')
     {
       i += 1;
 
       if (i >= current_line.size())
-        error("unexpected end of string in handling '\\'");
+      {
+        error(PODiagnostic::UNEXPECTED_END_OF_STRING, "unexpected end of string in handling '\\'");
+        return std::string_view();
+      }
+
+      escaped = true;
 
       switch (current_line[i])
       {
-        case 'a':  out << '\a'; break;
-        case 'b':  out << '\b'; break;
-        case 'v':  out << '\v'; break;
-        case 'n':  out << '\n'; break;
-        case 't':  out << '\t'; break;
-        case 'r':  out << '\r'; break;
-        case '"':  out << '"'; break;
-        case '\\': out << '\\'; break;
+        case 'a':
+        case 'b':
+        case 'v':
+        case 'n':
+        case 't':
+        case 'r':
+        case '"':
+        case '\\':
+          break;
+
         default:
           std::ostringstream err;
           err << "unhandled escape '\\" << current_line[i] << "'";
-          warning(err.str());
-
-          out << current_line[i-1] << current_line[i];
+          warning(PODiagnostic::UNKNOWN_ESCAPE, err.str());
           break;
       }
     }
-    else
-    {
-      out << current_line[i];
-    }
   }
 
+  if (i >= current_line.size())
+  {
+    error(PODiagnostic::UNEXPECTED_END_OF_STRING, "unexpected end of string");
+    return std::string_view();
+  }
+
+  const std::string_view str = current_line.substr(skip+1, i - (skip+1));
+
   // process trailing garbage in line and warn if there is any
-  for(i = i+1; i < current_line.size(); ++i)
-    if (!isspace(current_line[i]))
+  if (i + 1 < current_line.size() && scanner.skip_space(line_begin + i + 1, line_end) != line_end)
+    warning(PODiagnostic::GARBAGE_AFTER_STRING, "unexpected garbage after string ignoren");
+
+  return str;
+}
+
+void
+POParser::unescape(std::string_view str, std::string& out) const
+{
+  const char* const str_end = str.data() + str.size();
+  for(std::string_view::size_type i = 0; i < str.size(); ++i)
+  {
+    // copy everything up to the next escape in one go, get_string_line()
+    // already made sure that the string doesn't end within one
+    const std::string_view::size_type next = static_cast<std::string_view::size_type>(
+      scanner.find_string_special(str.data() + i, str_end, big5) - str.data());
+    out.append(str.data() + i, next - i);
+    i = next;
+
+    if (i >= str.size())
     {
-      warning("unexpected garbage after string ignoren");
       break;
     }
+    else if (big5 && static_cast<unsigned char>(str[i]) >= 0x81 && static_cast<unsigned char>(str[i]) <= 0xfe)
+    {
+      out += str[i];
+      i += 1;
+      out += str[i];
+    }
+    else if (str[i] == '\\')
+    {
+      i += 1;
+
+      switch (str[i])
+      {
+        case 'a':  out += '\a'; break;
+        case 'b':  out += '\b'; break;
+        case 'v':  out += '\v'; break;
+        case 'n':  out += '\n'; break;
+        case 't':  out += '\t'; break;
+        case 'r':  out += '\r'; break;
+        case '"':  out += '"'; break;
+        case '\\': out += '\\'; break;
+        default:
+          out += str[i-1];
+          out += str[i];
+          break;
+      }
+    }
+    else
+    {
+      out += str[i];
+    }
+  }
 }
 
-std::string
-POParser::get_string(unsigned int skip)
+std::string_view
+POParser::get_string(unsigned int skip, std::string& buffer)
 {
-  std::ostringstream out;
+  // the string is sliced out of the buffer as long as possible and
+  // only copied into 'buffer' once escapes or continuation lines
+  // make that impossible
+  std::string_view result;
+  bool in_buffer = false;
+  bool escaped = false;
+  std::string_view str;
 
-  if (skip+1 >= static_cast<unsigned int>(current_line.size()))
-    error("unexpected end of line");
+  if (skip+1 >= current_line.size())
+  {
+    error(PODiagnostic::UNEXPECTED_END_OF_LINE, "unexpected end of line");
+    return std::string_view();
+  }
 
   if (current_line[skip] == ' ' && current_line[skip+1] == '"')
   {
-    get_string_line(out, skip+1);
+    str = get_string_line(skip+1, escaped);
   }
   else
   {
     if (pedantic)
-      warning("keyword and string must be seperated by a single space");
+      warning(PODiagnostic::KEYWORD_SPACING, "keyword and string must be seperated by a single space");
 
     for(;;)
     {
-      if (skip >= static_cast<unsigned int>(current_line.size()))
-        error("unexpected end of line");
+      if (skip >= current_line.size())
+      {
+        error(PODiagnostic::UNEXPECTED_END_OF_LINE, "unexpected end of line");
+        return std::string_view();
+      }
       else if (current_line[skip] == '\"')
       {
-        get_string_line(out, skip);
+        str = get_string_line(skip, escaped);
         break;
       }
       else if (!isspace(current_line[skip]))
       {
-        error("string must start with '\"'");
+        error(PODiagnostic::EXPECTED_STRING, "string must start with '\"'");
+        return std::string_view();
       }
       else
       {
@@ -199,33 +751,79 @@ POParser::get_string(unsigned int skip)
     }
   }
 
+  if (failed)
+    return std::string_view();
+
+  if (escaped)
+  {
+    buffer.clear();
+    unescape(str, buffer);
+    in_buffer = true;
+  }
+  else
+  {
+    result = str;
+  }
+
 next:
   next_line();
-  for(std::string::size_type i = 0; i < current_line.size(); ++i)
+  std::string_view::size_type i = 0;
+  if (!current_line.empty() && isspace(current_line[0]))
+    i = static_cast<std::string_view::size_type>(
+      scanner.skip_space(current_line.data(), current_line.data() + current_line.size()) - current_line.data());
+
+  if (i < current_line.size() && current_line[i] == '"')
   {
-    if (current_line[i] == '"')
-    {
-      if (i == 1)
-        if (pedantic)
-          warning("leading whitespace before string");
+    if (i == 1)
+      if (pedantic)
+        warning(PODiagnostic::LEADING_WHITESPACE, "leading whitespace before string");
 
-      get_string_line(out,  i);
-      goto next;
-    }
-    else if (isspace(current_line[i]))
+    str = get_string_line(i, escaped);
+    if (failed)
+      return std::string_view();
+
+    if (!in_buffer && !escaped && result.empty())
     {
-      // skip
+      // common for long strings that start with an empty ""
+      result = str;
     }
     else
     {
-      break;
+      if (!in_buffer)
+      {
+        buffer.assign(result.data(), result.size());
+        in_buffer = true;
+      }
+
+      if (escaped)
+        unescape(str, buffer);
+      else
+        buffer.append(str.data(), str.size());
     }
+    goto next;
   }
 
-  return out.str();
+  if (in_buffer)
+    return buffer;
+  else
+    return result;
 }
 
-static bool has_prefix(const std::string& lhs, const std::string& rhs)
+std::string_view
+POParser::convert(std::string_view str)
+{
+  if (conv.is_identity())
+  {
+    return str;
+  }
+  else
+  {
+    convert_buffer = conv.convert(std::string(str));
+    return convert_buffer;
+  }
+}
+
+static bool has_prefix(std::string_view lhs, std::string_view rhs)
 {
   if (lhs.length() < rhs.length())
     return false;
@@ -234,15 +832,15 @@ static bool has_prefix(const std::string& lhs, const std::string& rhs)
 }
 
 void
-POParser::parse_header(const std::string& header)
+POParser::parse_header(std::string_view header)
 {
   std::string from_charset;
-  std::string::size_type start = 0;
-  for(std::string::size_type i = 0; i < header.length(); ++i)
+  std::string_view::size_type start = 0;
+  for(std::string_view::size_type i = 0; i < header.length(); ++i)
   {
     if (header[i] == '\n')
     {
-      std::string line = header.substr(start, i - start);
+      std::string_view line = header.substr(start, i - start);
 
       if (has_prefix(line, "Content-Type:"))
       {
@@ -250,22 +848,22 @@ POParser::parse_header(const std::string& header)
         size_t len = strlen("Content-Type: text/plain; charset=");
         if (line.compare(0, len, "Content-Type: text/plain; charset=") == 0)
         {
-          from_charset = line.substr(len);
+          from_charset = std::string(line.substr(len));
 
           for(std::string::iterator ch = from_charset.begin(); ch != from_charset.end(); ++ch)
             *ch = static_cast<char>(toupper(*ch));
         }
         else
         {
-          warning("malformed Content-Type header");
+          warning(PODiagnostic::MALFORMED_CONTENT_TYPE, "malformed Content-Type header");
         }
       }
       else if (has_prefix(line, "Plural-Forms:"))
       {
-        PluralForms plural_forms = PluralForms::from_string(line);
+        PluralForms plural_forms = PluralForms::from_string(std::string(line));
         if (!plural_forms)
         {
-          warning("unknown Plural-Forms given");
+          warning(PODiagnostic::UNKNOWN_PLURAL_FORMS, "unknown Plural-Forms given");
         }
         else
         {
@@ -277,7 +875,7 @@ POParser::parse_header(const std::string& header)
           {
             if (dict.get_plural_forms() != plural_forms)
             {
-              warning("Plural-Forms missmatch between .po file and dictionary");
+              warning(PODiagnostic::PLURAL_FORMS_MISMATCH, "Plural-Forms missmatch between .po file and dictionary");
             }
           }
         }
@@ -288,7 +886,7 @@ POParser::parse_header(const std::string& header)
 
   if (from_charset.empty() || from_charset == "CHARSET")
   {
-    warning("charset not specified for .po, fallback to utf-8");
+    warning(PODiagnostic::MISSING_CHARSET, "charset not specified for .po, fallback to utf-8");
     from_charset = "UTF-8";
   }
   else if (from_charset == "BIG5")
@@ -297,6 +895,8 @@ POParser::parse_header(const std::string& header)
   }
 
   conv.set_charsets(from_charset, dict.get_charset());
+  header_charset = from_charset;
+  has_header = true;
 }
 
 bool
@@ -310,15 +910,15 @@ POParser::is_empty_line()
   { // handle comments as empty lines
     return (current_line.size() == 1 || (current_line.size() >= 2 && isspace(current_line[1])));
   }
+  else if (!isspace(current_line[0]))
+  {
+    return false;
+  }
   else
   {
-    for(std::string::iterator i = current_line.begin(); i != current_line.end(); ++i)
-    {
-      if (!isspace(*i))
-        return false;
-    }
+    const char* const end = current_line.data() + current_line.size();
+    return scanner.skip_space(current_line.data(), end) == end;
   }
-  return true;
 }
 
 bool
@@ -342,152 +942,202 @@ POParser::parse()
     current_line = current_line.substr(3);
   }
 
+  parse_entries();
+}
+
+void
+POParser::parse_chunk(bool recovering)
+{
+  next_line();
+
+  // pick up where a sequential parse would continue after an error
+  // on the first line
+  if (recovering)
+    recover();
+
+  parse_entries();
+}
+
+void
+POParser::parse_entries()
+{
   // Parser structure
   while(!eof)
   {
-    try
+    // an entry with an error is skipped, parse_entry() returns once
+    // error() recovered to the start of the next one
+    failed = false;
+    parse_entry();
+  }
+}
+
+void
+POParser::parse_entry()
+{
+  bool fuzzy =  false;
+  bool has_msgctxt = false;
+  std::string_view msgctxt;
+  std::string_view msgid;
+  int msgid_line = 0;
+  std::string_view msgid_text;
+
+  while(prefix("#"))
+  {
+    if (current_line.size() >= 2 && current_line[1] == ',')
     {
-      bool fuzzy =  false;
-      bool has_msgctxt = false;
-      std::string msgctxt;
-      std::string msgid;
+      // FIXME: Rather simplistic hunt for fuzzy flag
+      if (current_line.find("fuzzy", 2) != std::string_view::npos)
+        fuzzy = true;
+    }
 
-      while(prefix("#"))
-      {
-        if (current_line.size() >= 2 && current_line[1] == ',')
-        {
-          // FIXME: Rather simplistic hunt for fuzzy flag
-          if (current_line.find("fuzzy", 2) != std::string::npos)
-            fuzzy = true;
-        }
+    next_line();
+  }
 
-        next_line();
-      }
+  if (!is_empty_line())
+  {
+    if (prefix("msgctxt"))
+    {
+      has_msgctxt = true;
+      msgctxt = get_string(7, msgctxt_buffer);
+      if (failed)
+        return;
+    }
 
-      if (!is_empty_line())
-      {
-        if (prefix("msgctxt"))
-        {
-          has_msgctxt = true;
-          msgctxt = get_string(7);
-        }
+    if (prefix("msgid"))
+    {
+      msgid_line = line_number;
+      msgid_text = current_line;
+      msgid = get_string(5, msgid_buffer);
+      if (failed)
+        return;
+    }
+    else
+    {
+      error(PODiagnostic::EXPECTED_MSGID, "expected 'msgid'");
+      return;
+    }
 
-        if (prefix("msgid"))
-          msgid = get_string(5);
-        else
-          error("expected 'msgid'");
+    if (prefix("msgid_plural"))
+    {
+      std::string_view msgid_plural = get_string(12, msgid_plural_buffer);
+      if (failed)
+        return;
 
-        if (prefix("msgid_plural"))
-        {
-          std::string msgid_plural = get_string(12);
-          std::vector<std::string> msgstr_num;
-	  bool saw_nonempty_msgstr = false;
+      std::vector<std::string> msgstr_num;
+      bool saw_nonempty_msgstr = false;
 
-        next:
-          if (is_empty_line())
-          {
-            if (msgstr_num.empty())
-              error("expected 'msgstr[N] (0 <= N <= 9)'");
-          }
-          else if (prefix("msgstr[") &&
-                   current_line.size() > 8 &&
-                   isdigit(current_line[7]) && current_line[8] == ']')
-          {
-            unsigned int number = static_cast<unsigned int>(current_line[7] - '0');
-	    std::string msgstr = get_string(9);
+    next:
+      if (is_empty_line())
+      {
+        if (msgstr_num.empty())
+        {
+          error(PODiagnostic::EXPECTED_MSGSTR, "expected 'msgstr[N] (0 <= N <= 9)'");
+          return;
+        }
+      }
+      else if (prefix("msgstr[") &&
+               current_line.size() > 8 &&
+               isdigit(current_line[7]) && current_line[8] == ']')
+      {
+        unsigned int number = static_cast<unsigned int>(current_line[7] - '0');
+        std::string_view msgstr = get_string(9, msgstr_buffer);
+        if (failed)
+          return;
 
-	    if(!msgstr.empty())
-	      saw_nonempty_msgstr = true;
+        if(!msgstr.empty())
+          saw_nonempty_msgstr = true;
 
-            if (number >= msgstr_num.size())
-              msgstr_num.resize(number+1);
+        if (number >= msgstr_num.size())
+          msgstr_num.resize(number+1);
 
-            msgstr_num[number] = conv.convert(msgstr);
-            goto next;
-          }
-          else
-          {
-            error("expected 'msgstr[N]'");
-          }
+        msgstr_num[number] = convert(msgstr);
+        goto next;
+      }
+      else
+      {
+        error(PODiagnostic::EXPECTED_MSGSTR, "expected 'msgstr[N]'");
+        return;
+      }
 
-          if (!is_empty_line())
-            error("expected 'msgstr[N]' or empty line");
+      if (!is_empty_line())
+      {
+        error(PODiagnostic::EXPECTED_MSGSTR, "expected 'msgstr[N]' or empty line");
+        return;
+      }
 
-	  if (saw_nonempty_msgstr)
-	  {
-	    if (use_fuzzy || !fuzzy)
-            {
-	      if (!dict.get_plural_forms())
-	      {
-		warning("msgstr[N] seen, but no Plural-Forms given");
-	      }
-	      else
-	      {
-		if (msgstr_num.size() != dict.get_plural_forms().get_nplural())
-		{
-		  warning("msgstr[N] count doesn't match Plural-Forms.nplural");
-		}
-	      }
-
-	      if (has_msgctxt)
-		dict.add_translation(msgctxt, msgid, msgid_plural, msgstr_num);
-	      else
-		dict.add_translation(msgid, msgid_plural, msgstr_num);
-	    }
-
-	    if ((false))
-	    {
-	      std::cout << (fuzzy?"fuzzy":"not-fuzzy") << std::endl;
-	      std::cout << "msgid \"" << msgid << "\"" << std::endl;
-	      std::cout << "msgid_plural \"" << msgid_plural << "\"" << std::endl;
-	      for(std::vector<std::string>::size_type i = 0; i < msgstr_num.size(); ++i)
-		std::cout << "msgstr[" << i << "] \"" << conv.convert(msgstr_num[i]) << "\"" << std::endl;
-	      std::cout << std::endl;
-	    }
-	  }
-        }
-        else if (prefix("msgstr"))
+      if (saw_nonempty_msgstr)
+      {
+        if (use_fuzzy || !fuzzy)
         {
-          std::string msgstr = get_string(6);
-
-          if (msgid.empty())
+          if (!dict.get_plural_forms())
           {
-            parse_header(msgstr);
+            warning(PODiagnostic::MISSING_PLURAL_FORMS, "msgstr[N] seen, but no Plural-Forms given");
           }
-          else if(!msgstr.empty())
+          else
           {
-            if (use_fuzzy || !fuzzy)
-            {
-              if (has_msgctxt)
-                dict.add_translation(msgctxt, msgid, conv.convert(msgstr));
-              else
-                dict.add_translation(msgid, conv.convert(msgstr));
-            }
-
-            if ((false))
+            if (msgstr_num.size() != dict.get_plural_forms().get_nplural())
             {
-              std::cout << (fuzzy?"fuzzy":"not-fuzzy") << std::endl;
-              std::cout << "msgid \"" << msgid << "\"" << std::endl;
-              std::cout << "msgstr \"" << conv.convert(msgstr) << "\"" << std::endl;
-              std::cout << std::endl;
+              warning(PODiagnostic::PLURAL_COUNT_MISMATCH, "msgstr[N] count doesn't match Plural-Forms.nplural");
             }
           }
+
+          add_translation(has_msgctxt ? std::optional<std::string_view>(msgctxt) : std::nullopt,
+                          msgid, msgstr_num, false, fuzzy, msgid_line, msgid_text);
         }
-        else
+
+        if ((false))
         {
-          error("expected 'msgstr' or 'msgid_plural'");
+          std::cout << (fuzzy?"fuzzy":"not-fuzzy") << std::endl;
+          std::cout << "msgid \"" << msgid << "\"" << std::endl;
+          std::cout << "msgid_plural \"" << msgid_plural << "\"" << std::endl;
+          for(std::vector<std::string>::size_type i = 0; i < msgstr_num.size(); ++i)
+            std::cout << "msgstr[" << i << "] \"" << msgstr_num[i] << "\"" << std::endl;
+          std::cout << std::endl;
         }
       }
+    }
+    else if (prefix("msgstr"))
+    {
+      std::string_view msgstr = get_string(6, msgstr_buffer);
+      if (failed)
+        return;
 
-      if (!is_empty_line())
-        error("expected empty line");
+      if (msgid.empty())
+      {
+        parse_header(msgstr);
+      }
+      else if(!msgstr.empty())
+      {
+        if (use_fuzzy || !fuzzy)
+        {
+          msgstrs_buffer.assign(1, std::string(convert(msgstr)));
+          add_translation(has_msgctxt ? std::optional<std::string_view>(msgctxt) : std::nullopt,
+                          msgid, msgstrs_buffer, true, fuzzy, msgid_line, msgid_text);
+        }
 
-      next_line();
+        if ((false))
+        {
+          std::cout << (fuzzy?"fuzzy":"not-fuzzy") << std::endl;
+          std::cout << "msgid \"" << msgid << "\"" << std::endl;
+          std::cout << "msgstr \"" << convert(msgstr) << "\"" << std::endl;
+          std::cout << std::endl;
+        }
+      }
     }
-    catch(POParserError&)
+    else
     {
+      error(PODiagnostic::EXPECTED_MSGSTR, "expected 'msgstr' or 'msgid_plural'");
+      return;
     }
   }
+
+  if (!is_empty_line())
+  {
+    error(PODiagnostic::EXPECTED_EMPTY_LINE, "expected empty line");
+    return;
+  }
+
+  next_line();
 }
 
 } // namespace tinygettext
@@ -0,0 +1,288 @@
+// tinygettext - A gettext replacement that works directly on .po files
+// Copyright (c) 2009 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgement in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "tinygettext/po_scanner.hpp"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define TINYGETTEXT_SCANNER_X86
+#  include <immintrin.h>
+#endif
+
+namespace tinygettext {
+
+namespace {
+
+struct Implementation
+{
+  const char* name;
+  const char* (*find_string_special)(const char* begin, const char* end, bool high_bytes);
+  const char* (*find_newline)(const char* begin, const char* end);
+  const char* (*skip_space)(const char* begin, const char* end);
+};
+
+inline bool is_space(char c)
+{
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+const char* find_string_special_generic(const char* begin, const char* end, bool high_bytes)
+{
+  for(const char* p = begin; p != end; ++p)
+  {
+    if (*p == '"' || *p == '\\' || (high_bytes && static_cast<unsigned char>(*p) >= 0x80))
+      return p;
+  }
+  return end;
+}
+
+const char* find_newline_generic(const char* begin, const char* end)
+{
+  const void* p = memchr(begin, '\n', static_cast<size_t>(end - begin));
+  return p ? static_cast<const char*>(p) : end;
+}
+
+const char* skip_space_generic(const char* begin, const char* end)
+{
+  for(const char* p = begin; p != end; ++p)
+  {
+    if (!is_space(*p))
+      return p;
+  }
+  return end;
+}
+
+const Implementation generic = {
+  "generic",
+  &find_string_special_generic,
+  &find_newline_generic,
+  &skip_space_generic
+};
+
+#ifdef TINYGETTEXT_SCANNER_X86
+
+// The vector searches turn every chunk into a bit mask of the bytes
+// that match, the first set bit is the result. Ranges that don't end
+// on a chunk boundary get one more chunk that overlaps the previous
+// one, which is fine as the bytes in front of the current position
+// are known not to match. Only ranges shorter than a single chunk are
+// left to the plain loops.
+
+__attribute__((target("sse2")))
+inline uint32_t string_special_mask_sse2(const char* p, bool high_bytes)
+{
+  const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  const __m128i special = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                                       _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+  uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(special));
+  if (high_bytes)
+    mask |= static_cast<uint32_t>(_mm_movemask_epi8(v));
+  return mask;
+}
+
+__attribute__((target("sse2")))
+inline uint32_t newline_mask_sse2(const char* p)
+{
+  const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+}
+
+__attribute__((target("sse2")))
+inline uint32_t non_space_mask_sse2(const char* p)
+{
+  const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  // '\t' to '\r' are found by an unsigned range check: v - '\t' <= 4
+  const __m128i offset = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+  const __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(4)), offset);
+  const __m128i space = _mm_or_si128(control, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+  return ~static_cast<uint32_t>(_mm_movemask_epi8(space)) & 0xffffu;
+}
+
+__attribute__((target("avx2")))
+inline uint32_t string_special_mask_avx2(const char* p, bool high_bytes)
+{
+  const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+  const __m256i special = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+                                          _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+  uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(special));
+  if (high_bytes)
+    mask |= static_cast<uint32_t>(_mm256_movemask_epi8(v));
+  return mask;
+}
+
+__attribute__((target("avx2")))
+inline uint32_t newline_mask_avx2(const char* p)
+{
+  const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+  return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+}
+
+__attribute__((target("avx2")))
+inline uint32_t non_space_mask_avx2(const char* p)
+{
+  const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+  const __m256i offset = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+  const __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(offset, _mm256_set1_epi8(4)), offset);
+  const __m256i space = _mm256_or_si256(control, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+  return ~static_cast<uint32_t>(_mm256_movemask_epi8(space));
+}
+
+// Body of the vector searches, MASK(p) is the bit mask of the matches
+// in the chunk at p, FALLBACK handles ranges shorter than a chunk.
+// This is a macro as the mask has to be inlined into a function
+// compiled for the same instruction set.
+#define TINYGETTEXT_SCAN(SIZE, MASK, FALLBACK)                  \
+  if (end - begin < (SIZE))                                     \
+    return FALLBACK;                                            \
+                                                                \
+  const char* p = begin;                                        \
+  for(; end - p >= (SIZE); p += (SIZE))                         \
+  {                                                             \
+    const uint32_t bits = MASK;                                 \
+    if (bits)                                                   \
+      return p + __builtin_ctz(bits);                           \
+  }                                                             \
+                                                                \
+  if (p != end)                                                 \
+  {                                                             \
+    p = end - (SIZE);                                           \
+    const uint32_t bits = MASK;                                 \
+    if (bits)                                                   \
+      return p + __builtin_ctz(bits);                           \
+  }                                                             \
+                                                                \
+  return end
+
+__attribute__((target("sse2")))
+const char* find_string_special_sse2(const char* begin, const char* end, bool high_bytes)
+{
+  TINYGETTEXT_SCAN(16, string_special_mask_sse2(p, high_bytes),
+                   find_string_special_generic(begin, end, high_bytes));
+}
+
+__attribute__((target("sse2")))
+const char* find_newline_sse2(const char* begin, const char* end)
+{
+  TINYGETTEXT_SCAN(16, newline_mask_sse2(p), find_newline_generic(begin, end));
+}
+
+__attribute__((target("sse2")))
+const char* skip_space_sse2(const char* begin, const char* end)
+{
+  TINYGETTEXT_SCAN(16, non_space_mask_sse2(p), skip_space_generic(begin, end));
+}
+
+__attribute__((target("avx2")))
+const char* find_string_special_avx2(const char* begin, const char* end, bool high_bytes)
+{
+  TINYGETTEXT_SCAN(32, string_special_mask_avx2(p, high_bytes),
+                   find_string_special_sse2(begin, end, high_bytes));
+}
+
+__attribute__((target("avx2")))
+const char* find_newline_avx2(const char* begin, const char* end)
+{
+  TINYGETTEXT_SCAN(32, newline_mask_avx2(p), find_newline_sse2(begin, end));
+}
+
+__attribute__((target("avx2")))
+const char* skip_space_avx2(const char* begin, const char* end)
+{
+  TINYGETTEXT_SCAN(32, non_space_mask_avx2(p), skip_space_sse2(begin, end));
+}
+
+#undef TINYGETTEXT_SCAN
+
+const Implementation sse2 = {
+  "sse2",
+  &find_string_special_sse2,
+  &find_newline_sse2,
+  &skip_space_sse2
+};
+
+const Implementation avx2 = {
+  "avx2",
+  &find_string_special_avx2,
+  &find_newline_avx2,
+  &skip_space_avx2
+};
+
+#endif
+
+const Implementation& select_implementation()
+{
+#ifdef TINYGETTEXT_SCANNER_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return avx2;
+  else if (__builtin_cpu_supports("sse2"))
+    return sse2;
+#endif
+  return generic;
+}
+
+const Implementation& find_implementation(const std::string& name)
+{
+#ifdef TINYGETTEXT_SCANNER_X86
+  __builtin_cpu_init();
+  if (name == avx2.name && __builtin_cpu_supports("avx2"))
+    return avx2;
+  else if (name == sse2.name && __builtin_cpu_supports("sse2"))
+    return sse2;
+#endif
+  if (name == generic.name)
+    return generic;
+  return select_implementation();
+}
+
+} // namespace
+
+POScanner::POScanner() :
+  name(),
+  find_string_special_fn(),
+  find_newline_fn(),
+  skip_space_fn()
+{
+  static const Implementation& implementation = select_implementation();
+
+  name = implementation.name;
+  find_string_special_fn = implementation.find_string_special;
+  find_newline_fn = implementation.find_newline;
+  skip_space_fn = implementation.skip_space;
+}
+
+POScanner::POScanner(const std::string& implementation_name) :
+  name(),
+  find_string_special_fn(),
+  find_newline_fn(),
+  skip_space_fn()
+{
+  const Implementation& implementation = find_implementation(implementation_name);
+
+  name = implementation.name;
+  find_string_special_fn = implementation.find_string_special;
+  find_newline_fn = implementation.find_newline;
+  skip_space_fn = implementation.skip_space;
+}
+
+} // namespace tinygettext
+
+/* EOF */
@@ -0,0 +1,99 @@
+// tinygettext - A gettext replacement that works directly on .po files
+// Copyright (c) 2006 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgement in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+
+#include "tinygettext/translator.hpp"
+
+namespace tinygettext {
+
+Translator::Translator() :
+  language(),
+  dict()
+{
+}
+
+Translator::Translator(const Language& language_, std::shared_ptr<const Dictionary> dict_) :
+  language(language_),
+  dict(std::move(dict_))
+{
+}
+
+std::string
+Translator::translate(std::string_view msgid) const
+{
+  return std::string(translate_view(msgid));
+}
+
+std::string
+Translator::translate_plural(std::string_view msgid, std::string_view msgidplural, int num) const
+{
+  return std::string(translate_plural_view(msgid, msgidplural, num));
+}
+
+std::string
+Translator::translate_ctxt(std::string_view msgctxt, std::string_view msgid) const
+{
+  return std::string(translate_ctxt_view(msgctxt, msgid));
+}
+
+std::string
+Translator::translate_ctxt_plural(std::string_view msgctxt, std::string_view msgid, std::string_view msgidplural, int num) const
+{
+  return std::string(translate_ctxt_plural_view(msgctxt, msgid, msgidplural, num));
+}
+
+std::string_view
+Translator::translate_view(std::string_view msgid) const
+{
+  if (!dict)
+    return msgid;
+  else
+    return dict->translate_view(msgid);
+}
+
+std::string_view
+Translator::translate_plural_view(std::string_view msgid, std::string_view msgidplural, int num) const
+{
+  if (!dict)
+    return (num == 1) ? msgid : msgidplural; // default to english rules
+  else
+    return dict->translate_plural_view(msgid, msgidplural, num);
+}
+
+std::string_view
+Translator::translate_ctxt_view(std::string_view msgctxt, std::string_view msgid) const
+{
+  if (!dict)
+    return msgid;
+  else
+    return dict->translate_ctxt_view(msgctxt, msgid);
+}
+
+std::string_view
+Translator::translate_ctxt_plural_view(std::string_view msgctxt, std::string_view msgid, std::string_view msgidplural, int num) const
+{
+  if (!dict)
+    return (num == 1) ? msgid : msgidplural; // default to english rules
+  else
+    return dict->translate_ctxt_plural_view(msgctxt, msgid, msgidplural, num);
+}
+
+} // namespace tinygettext
+
+/* EOF */
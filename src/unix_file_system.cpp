@@ -30,8 +30,168 @@
 
 #include <stdlib.h>
 
+#ifdef __linux__
+#  include <algorithm>
+#  include <chrono>
+#  include <errno.h>
+#  include <mutex>
+#  include <poll.h>
+#  include <string.h>
+#  include <sys/eventfd.h>
+#  include <sys/inotify.h>
+#  include <unistd.h>
+#  include <unordered_map>
+#endif
+
+#include "tinygettext/log_stream.hpp"
+
 namespace tinygettext {
 
+namespace {
+
+#ifdef __linux__
+class InotifyWatcher : public FileWatcher
+{
+private:
+  int fd;
+
+  /** eventfd that becomes readable once stop() is called */
+  int stop_fd;
+
+  std::mutex mutex;
+  std::unordered_map<int, std::string> directories;
+
+public:
+  InotifyWatcher() :
+    fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)),
+    stop_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+    mutex(),
+    directories()
+  {}
+
+  ~InotifyWatcher() override
+  {
+    if (fd >= 0)
+      close(fd);
+    if (stop_fd >= 0)
+      close(stop_fd);
+  }
+
+  bool is_valid() const { return fd >= 0 && stop_fd >= 0; }
+
+  void add_directory(const std::string& pathname) override
+  {
+    // files are only reported once they are closed, not on every
+    // write, editors that save by renaming a new file over the old
+    // one are covered by IN_MOVED_TO
+    const int wd = inotify_add_watch(fd, pathname.c_str(),
+                                     IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                                     IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+    if (wd < 0)
+    {
+      log_warning << "warning: can't watch " << pathname << ": " << strerror(errno) << std::endl;
+    }
+    else
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      directories[wd] = pathname;
+    }
+  }
+
+  void remove_directory(const std::string& pathname) override
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for(std::unordered_map<int, std::string>::iterator i = directories.begin(); i != directories.end(); ++i)
+    {
+      if (i->second == pathname)
+      {
+        inotify_rm_watch(fd, i->first);
+        directories.erase(i);
+        break;
+      }
+    }
+  }
+
+  bool wait(int timeout_ms, std::vector<std::string>& changed, bool& overflow) override
+  {
+    const std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+    pollfd fds[2] = { { fd, POLLIN, 0 }, { stop_fd, POLLIN, 0 } };
+    while (poll(fds, 2, timeout_ms) < 0)
+    {
+      if (errno != EINTR)
+      {
+        log_error << "error: waiting for file changes failed: " << strerror(errno) << std::endl;
+        return false;
+      }
+
+      // interrupted by a signal, wait for the rest of the timeout, an
+      // early return would end the reload delay too soon
+      if (timeout_ms > 0)
+      {
+        const std::chrono::milliseconds left = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now());
+        timeout_ms = std::max(0, static_cast<int>(left.count()));
+      }
+    }
+
+    // the eventfd is never read, so it stays readable
+    if (fds[1].revents & POLLIN)
+      return false;
+
+    if (fds[0].revents & POLLIN)
+      read_events(changed, overflow);
+
+    return true;
+  }
+
+  void stop() override
+  {
+    const uint64_t one = 1;
+    if (write(stop_fd, &one, sizeof(one)) < 0)
+    {
+      log_error << "error: stopping the file watcher failed: " << strerror(errno) << std::endl;
+    }
+  }
+
+private:
+  void read_events(std::vector<std::string>& changed, bool& overflow)
+  {
+    alignas(inotify_event) char buffer[4096];
+    for(;;)
+    {
+      const ssize_t len = read(fd, buffer, sizeof(buffer));
+      if (len <= 0)
+        break;
+
+      std::lock_guard<std::mutex> lock(mutex);
+      for(const char* p = buffer; p < buffer + len; )
+      {
+        const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+        if (event->mask & IN_Q_OVERFLOW)
+        {
+          log_warning << "warning: too many file changes at once, reloading everything" << std::endl;
+          overflow = true;
+        }
+        else if (event->len > 0)
+        {
+          std::unordered_map<int, std::string>::iterator dir = directories.find(event->wd);
+          if (dir != directories.end())
+            changed.push_back(dir->second + "/" + event->name);
+        }
+        p += sizeof(inotify_event) + event->len;
+      }
+    }
+  }
+
+  InotifyWatcher(const InotifyWatcher&) = delete;
+  InotifyWatcher& operator=(const InotifyWatcher&) = delete;
+};
+#endif
+
+} // namespace
+
 UnixFileSystem::UnixFileSystem()
 {
 }
@@ -53,6 +213,30 @@ UnixFileSystem::open_file(const std::string& filename)
   return std::unique_ptr<std::istream>(new std::ifstream(filename));
 }
 
+int64_t
+UnixFileSystem::get_modification_time(const std::string& pathname)
+{
+  std::error_code ec;
+  std::filesystem::file_time_type time = std::filesystem::last_write_time(pathname, ec);
+  if (ec)
+    return 0;
+  else
+    return static_cast<int64_t>(time.time_since_epoch().count());
+}
+
+std::unique_ptr<FileWatcher>
+UnixFileSystem::create_watcher()
+{
+#ifdef __linux__
+  std::unique_ptr<InotifyWatcher> watcher(new InotifyWatcher);
+  if (watcher->is_valid())
+    return std::unique_ptr<FileWatcher>(std::move(watcher));
+
+  log_warning << "warning: inotify not available: " << strerror(errno) << std::endl;
+#endif
+  return std::unique_ptr<FileWatcher>();
+}
+
 } // namespace tinygettext
 
 /* EOF */
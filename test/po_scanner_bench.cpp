@@ -0,0 +1,229 @@
+// tinygettext - A gettext replacement that works directly on .po files
+// Copyright (c) 2009 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgement in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+#include "tinygettext/dictionary.hpp"
+#include "tinygettext/po_parser.hpp"
+#include "tinygettext/po_scanner.hpp"
+
+using namespace tinygettext;
+
+namespace {
+
+/** The input is repeated until it is at least this large, so that
+    each pass takes long enough to be measured */
+const size_t min_size = 64 * 1024 * 1024;
+
+const int runs = 5;
+
+/** Scan \a text the way the parser does: find the end of each line,
+    skip the leading whitespace and look for the quotes and escapes
+    in the rest. Returns the number of matches, which has to be the
+    same for every implementation. */
+size_t scan(const POScanner& scanner, const std::string& text)
+{
+  size_t matches = 0;
+  const char* p = text.data();
+  const char* const end = text.data() + text.size();
+  while (p != end)
+  {
+    const char* eol = scanner.find_newline(p, end);
+    for(const char* s = scanner.skip_space(p, eol); s != eol; ++s)
+    {
+      s = scanner.find_string_special(s, eol, true);
+      if (s == eol)
+        break;
+      matches += 1;
+    }
+    p = (eol == end) ? end : eol + 1;
+  }
+  return matches;
+}
+
+/** A catalog of about \a size bytes with entries like those of a
+    real one: references, contexts, plural forms, escapes and strings
+    spanning multiple lines */
+std::string make_catalog(size_t size)
+{
+  std::string catalog =
+    "msgid \"\"\n"
+    "msgstr \"\"\n"
+    "\"Content-Type: text/plain; charset=UTF-8\\n\"\n"
+    "\"Plural-Forms: nplurals=2; plural=(n != 1);\\n\"\n";
+  for(size_t i = 0; catalog.size() < size; ++i)
+  {
+    const std::string n = std::to_string(i);
+    catalog += "\n#: src/file" + std::to_string(i % 97) + ".cpp:" + n + "\n";
+    if (i % 7 == 0)
+      catalog += "msgctxt \"menu\"\n";
+
+    if (i % 5 == 0)
+    {
+      catalog += "msgid \"" + n + " file was \\\"saved\\\"\"\n";
+      catalog += "msgid_plural \"" + n + " files were \\\"saved\\\"\"\n";
+      catalog += "msgstr[0] \"" + n + " Datei wurde „gespeichert“\"\n";
+      catalog += "msgstr[1] \"" + n + " Dateien wurden „gespeichert“\"\n";
+    }
+    else if (i % 3 == 0)
+    {
+      catalog += "msgid \"\"\n\"Message " + n + " is long enough to be wrapped, \"\n\"so it spans two lines.\\n\"\n";
+      catalog += "msgstr \"\"\n\"Nachricht " + n + " ist so lang, dass sie umbrochen wird \"\n\"und zwei Zeilen belegt.\\n\"\n";
+    }
+    else
+    {
+      catalog += "msgid \"Message " + n + "\"\n";
+      catalog += "msgstr \"Nachricht " + n + "\"\n";
+    }
+  }
+  return catalog;
+}
+
+size_t count_translations(Dictionary& dict)
+{
+  size_t count = 0;
+  dict.foreach([&count](const std::string&, const std::vector<std::string>&) { count += 1; });
+  dict.foreach_ctxt([&count](const std::string&, const std::string&, const std::vector<std::string>&) { count += 1; });
+  return count;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    std::cout << argv[0] << " FILENAME..." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::string input;
+  for(int i = 1; i < argc; ++i)
+  {
+    std::ifstream in(argv[i], std::ios::binary);
+    if (!in)
+    {
+      std::cerr << argv[0] << ": cannot access " << argv[i] << ": " << strerror(errno) << std::endl;
+      return EXIT_FAILURE;
+    }
+    input.append(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+
+  if (input.empty())
+  {
+    std::cerr << argv[0] << ": nothing to scan" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::string text;
+  while (text.size() < min_size)
+    text += input;
+
+  std::cout << "scanning " << text.size() / (1024 * 1024) << " MiB, best of " << runs << " runs" << std::endl;
+
+  size_t expected = 0;
+  const char* implementations[] = { "generic", "sse2", "avx2" };
+  for(const char* name : implementations)
+  {
+    const POScanner scanner(name);
+    if (scanner.get_implementation() != std::string(name))
+    {
+      std::cout << std::setw(8) << name << ": not supported" << std::endl;
+      continue;
+    }
+
+    double best = 0.0;
+    size_t matches = 0;
+    for(int run = 0; run < runs; ++run)
+    {
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      matches = scan(scanner, text);
+      const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      if (run == 0 || seconds < best)
+        best = seconds;
+    }
+
+    if (expected == 0)
+      expected = matches;
+
+    std::cout << std::setw(8) << name << ": "
+              << std::fixed << std::setprecision(2) << std::setw(8) << best * 1000.0 << " ms, "
+              << std::setw(8) << static_cast<double>(text.size()) / (1024 * 1024) / best << " MiB/s";
+    if (matches != expected)
+    {
+      std::cout << ", found " << matches << " matches instead of " << expected << std::endl;
+      return EXIT_FAILURE;
+    }
+    std::cout << std::endl;
+  }
+
+  // the same for the parser as a whole, with each scanner forced
+  const std::string catalog = make_catalog(min_size / 4);
+  std::cout << "parsing " << catalog.size() / (1024 * 1024) << " MiB, best of " << runs << " runs" << std::endl;
+
+  size_t expected_translations = 0;
+  for(const char* name : implementations)
+  {
+    if (POScanner(name).get_implementation() != std::string(name))
+    {
+      std::cout << std::setw(8) << name << ": not supported" << std::endl;
+      continue;
+    }
+    POParser::scanner_implementation = name;
+
+    double best = 0.0;
+    size_t translations = 0;
+    for(int run = 0; run < runs; ++run)
+    {
+      Dictionary dict;
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      POParser::parse("catalog.po", catalog, dict);
+      const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      if (run == 0 || seconds < best)
+        best = seconds;
+      translations = count_translations(dict);
+    }
+
+    if (expected_translations == 0)
+      expected_translations = translations;
+
+    std::cout << std::setw(8) << name << ": "
+              << std::fixed << std::setprecision(2) << std::setw(8) << best * 1000.0 << " ms, "
+              << std::setw(8) << static_cast<double>(catalog.size()) / (1024 * 1024) / best << " MiB/s";
+    if (translations != expected_translations)
+    {
+      std::cout << ", got " << translations << " translations instead of " << expected_translations << std::endl;
+      return EXIT_FAILURE;
+    }
+    std::cout << std::endl;
+  }
+  POParser::scanner_implementation.clear();
+
+  return EXIT_SUCCESS;
+}
+
+/* EOF */
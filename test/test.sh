@@ -4,5 +4,19 @@
 ./tinygettext_test directory po/ umlaut Deutsch
 ./tinygettext_test directory po/ umlaut deutsch
 ./tinygettext_test directory po/ umlaut de
+./tinygettext_test misses po/fr.po "invalid" "missing" "invalid"
+./tinygettext_test entry-table
+./tinygettext_test fuzzy po/ de_AT "-Idea"
+./tinygettext_test diagnostics broken.po
+./tinygettext_test chunks broken.po duplicates.po po/de.po po/fr.po level/de.po
+./tinygettext_test feed broken.po duplicates.po po/de.po po/de_AT.po po/fr.po game/de.po level/de.po
+./tinygettext_test singular duplicates.po
+./tinygettext_test rescan
+./tinygettext_test directories
+./tinygettext_test watch
+./tinygettext_test load-async
+./tinygettext_test preload
+./tinygettext_test charset
+./tinygettext_test incremental
 
 # EOF #
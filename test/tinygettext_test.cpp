@@ -17,12 +17,30 @@
 //    misrepresented as being the original software.
 // 3. This notice may not be removed or altered from any source distribution.
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <errno.h>
 #include <iostream>
 #include <string.h>
 #include <fstream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <iostream>
 #include <stdexcept>
+#include <thread>
+#include "tinygettext/entry_table.hpp"
+#include "tinygettext/executor.hpp"
+#include "tinygettext/file_watcher.hpp"
+#include "tinygettext/log.hpp"
+#include "tinygettext/po_block_index.hpp"
 #include "tinygettext/po_parser.hpp"
 #include "tinygettext/tinygettext.hpp"
 #include "tinygettext/unix_file_system.hpp"
@@ -58,6 +76,20 @@ void print_usage(int /*argc*/, char** argv)
   std::cout << "       " << argv[0] << " language LANGUAGE" << std::endl;
   std::cout << "       " << argv[0] << " language-dir DIR" << std::endl;
   std::cout << "       " << argv[0] << " list-msgstrs FILE" << std::endl;
+  std::cout << "       " << argv[0] << " misses FILE MESSAGE..." << std::endl;
+  std::cout << "       " << argv[0] << " entry-table [OPERATIONS]" << std::endl;
+  std::cout << "       " << argv[0] << " fuzzy DIRECTORY LANGUAGE MESSAGE" << std::endl;
+  std::cout << "       " << argv[0] << " diagnostics FILE" << std::endl;
+  std::cout << "       " << argv[0] << " chunks FILE..." << std::endl;
+  std::cout << "       " << argv[0] << " feed FILE..." << std::endl;
+  std::cout << "       " << argv[0] << " singular FILE" << std::endl;
+  std::cout << "       " << argv[0] << " rescan" << std::endl;
+  std::cout << "       " << argv[0] << " directories" << std::endl;
+  std::cout << "       " << argv[0] << " watch" << std::endl;
+  std::cout << "       " << argv[0] << " load-async" << std::endl;
+  std::cout << "       " << argv[0] << " preload" << std::endl;
+  std::cout << "       " << argv[0] << " charset" << std::endl;
+  std::cout << "       " << argv[0] << " incremental" << std::endl;
 }
 
 void read_dictionary(const std::string& filename, Dictionary& dict)
@@ -75,6 +107,1246 @@ void read_dictionary(const std::string& filename, Dictionary& dict)
     }
 }
 
+typedef std::map<std::string, EntryTable::Entry> EntryMap;
+
+/** Returns a random msgid or msgctxt, short and from a small
+    alphabet, so that keys repeat and are often empty */
+std::string random_string(std::mt19937& rng)
+{
+  const char alphabet[] = "ab\xc3\xa4 ";
+  std::string result(rng() % 3, ' ');
+  for(std::string::iterator i = result.begin(); i != result.end(); ++i)
+    *i = alphabet[rng() % (sizeof(alphabet) - 1)];
+  return result;
+}
+
+bool same_msgstrs(const EntryTable::Msgstrs& msgstrs, const std::vector<std::string>& expected)
+{
+  if (msgstrs.size() != expected.size())
+    return false;
+  for(size_t n = 0; n < expected.size(); ++n)
+    if (msgstrs[n] != expected[n])
+      return false;
+  return true;
+}
+
+bool same_entry(const EntryTable::Entry& entry, const EntryTable::Entry& expected)
+{
+  return (entry.msgstrs == expected.msgstrs && entry.fuzzy == expected.fuzzy &&
+          entry.finished == expected.finished);
+}
+
+/** Compares \a table to \a expected, which holds the joined keys of
+    the entries with a context */
+bool check_entry_table(const EntryTable& table, const EntryMap& expected, const char* step)
+{
+  bool ok = table.size() == expected.size();
+
+  for(EntryMap::const_iterator i = expected.begin(); i != expected.end() && ok; ++i)
+  {
+    std::optional<EntryTable::Msgstrs> msgstrs;
+    const std::string::size_type separator = i->first.find(EntryTable::ctxt_separator);
+    if (separator == std::string::npos)
+      msgstrs = table.find(i->first);
+    else
+      msgstrs = table.find(std::string_view(i->first).substr(0, separator),
+                           std::string_view(i->first).substr(separator + 1));
+
+    // the joined key finds an entry with context as well
+    std::optional<EntryTable::Msgstrs> joined = table.find(i->first);
+
+    ok = (msgstrs && joined &&
+          same_msgstrs(*msgstrs, i->second.msgstrs) && same_msgstrs(*joined, i->second.msgstrs) &&
+          msgstrs->is_fuzzy() == i->second.fuzzy &&
+          same_msgstrs(msgstrs->finished(), i->second.finished));
+  }
+
+  size_t visited = 0;
+  table.foreach_entry([&expected, &visited, &ok](const EntryTable::Entry& entry) {
+    EntryMap::const_iterator i = expected.find(entry.key);
+    ok = ok && i != expected.end() && same_entry(entry, i->second);
+    visited += 1;
+  });
+  ok = ok && visited == expected.size();
+
+  if (!ok)
+    std::cout << "entry-table: mismatch after " << step << std::endl;
+  return ok;
+}
+
+/** Runs random operations on an EntryTable and a std::map side by
+    side and compares them after each one */
+bool test_entry_table(int operations)
+{
+  std::mt19937 rng(1);
+  EntryTable table;
+  EntryMap expected;
+
+  for(int op = 0; op < operations; ++op)
+  {
+    const std::string msgid = random_string(rng);
+    const bool has_ctxt = rng() % 2 == 0;
+    const std::string msgctxt = has_ctxt ? random_string(rng) : std::string();
+    const std::string key = has_ctxt ? msgctxt + EntryTable::ctxt_separator + msgid : msgid;
+    const char* step;
+
+    switch (rng() % 18)
+    {
+      case 0: case 1: case 2: case 3: case 4: case 5: case 6:
+      {
+        step = "get";
+        EntryTable::Entry& entry = has_ctxt ? table.get(msgctxt, msgid) : table.get(msgid);
+        entry.msgstrs.assign(rng() % 3, random_string(rng));
+        entry.fuzzy = rng() % 4 == 0;
+        entry.finished.assign(entry.fuzzy ? rng() % 3 : 0, random_string(rng));
+        expected[key] = entry;
+        break;
+      }
+
+      case 7: case 8: case 9:
+      {
+        step = "erase";
+        const bool erased = has_ctxt ? table.erase(msgctxt, msgid) : table.erase(msgid);
+        if (erased != (expected.erase(key) == 1))
+        {
+          std::cout << "entry-table: erase returned " << erased << std::endl;
+          return false;
+        }
+        break;
+      }
+
+      case 10: case 11: case 12:
+      {
+        step = "find";
+        const bool found = static_cast<bool>(has_ctxt ? table.find(msgctxt, msgid) : table.find(msgid));
+        if (found != (expected.count(key) == 1))
+        {
+          std::cout << "entry-table: find returned " << found << std::endl;
+          return false;
+        }
+        break;
+      }
+
+      case 13:
+      {
+        // entries of the merged table replace existing ones
+        step = "merge";
+        EntryTable other;
+        for(int n = static_cast<int>(rng() % 8); n > 0; --n)
+        {
+          EntryTable::Entry& entry = other.get(random_string(rng));
+          entry.msgstrs.assign(1 + rng() % 2, random_string(rng));
+          expected[entry.key] = entry;
+        }
+        table.merge(std::move(other), [](EntryTable::Entry& entry, EntryTable::Entry& other_entry, size_t) {
+          entry = other_entry;
+        });
+        break;
+      }
+
+      case 14:
+        step = "freeze";
+        table.freeze();
+        break;
+
+      case 15:
+      {
+        // like a reloaded file: some entries are removed, some are
+        // replaced and some are added
+        step = "patch";
+        EntryTable removed;
+        EntryTable added;
+        for(EntryMap::const_iterator i = expected.begin(); i != expected.end(); ++i)
+        {
+          switch (rng() % 8)
+          {
+            case 0:
+              removed.get(i->first);
+              break;
+            case 1:
+              removed.get(i->first);
+              added.get(i->first).msgstrs.assign(1, random_string(rng));
+              break;
+            case 2:
+              added.get(i->first).msgstrs.assign(2, random_string(rng));
+              break;
+          }
+        }
+        for(int n = static_cast<int>(rng() % 4); n > 0; --n)
+        {
+          EntryTable::Entry& entry = added.get(random_string(rng));
+          entry.msgstrs.assign(1, random_string(rng));
+          entry.fuzzy = rng() % 2 == 0;
+          entry.finished.assign(entry.fuzzy ? 1 : 0, random_string(rng));
+        }
+
+        removed.foreach_entry([&expected](const EntryTable::Entry& entry) {
+          expected.erase(entry.key);
+        });
+        added.foreach_entry([&expected](const EntryTable::Entry& entry) {
+          expected[entry.key] = entry;
+        });
+
+        EntryTable patched;
+        patched.assign_patched(table, removed, added);
+        table = std::move(patched);
+        if (!table.is_frozen())
+        {
+          std::cout << "entry-table: the patched table isn't frozen" << std::endl;
+          return false;
+        }
+        break;
+      }
+
+      default:
+        step = "freeze with perfect hash";
+        table.freeze(true);
+        if (!table.empty() && !table.has_perfect_hash())
+        {
+          std::cout << "entry-table: no perfect hash built" << std::endl;
+          return false;
+        }
+        break;
+    }
+
+    if (!check_entry_table(table, expected, step))
+      return false;
+  }
+
+  std::cout << "entry-table: " << operations << " operations, " << table.size() << " entries: ok" << std::endl;
+  return true;
+}
+
+/** Checks that \a dict translates "Hello" to \a with_fuzzy while
+    fuzzy translations are enabled and to \a without_fuzzy otherwise */
+bool check_fuzzy(Dictionary& dict, const char* with_fuzzy, const char* without_fuzzy, const char* step)
+{
+  dict.set_use_fuzzy(true);
+  const std::string result_with = dict.translate("Hello");
+  dict.set_use_fuzzy(false);
+  const std::string result_without = dict.translate("Hello");
+  dict.set_use_fuzzy(true);
+
+  if (result_with != with_fuzzy || result_without != without_fuzzy)
+  {
+    std::cout << "fuzzy: " << step << ": '" << result_with << "', '" << result_without
+              << "' instead of '" << with_fuzzy << "', '" << without_fuzzy << "'" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+/** The last translation added wins while fuzzy translations are
+    enabled, a finished one it replaced is used otherwise */
+bool test_fuzzy_duplicates()
+{
+  Dictionary fuzzy_last;
+  fuzzy_last.add_translation("Hello", "Hallo");
+  fuzzy_last.add_fuzzy_translation("Hello", "Servus");
+
+  Dictionary fuzzy_first;
+  fuzzy_first.add_fuzzy_translation("Hello", "Servus");
+  fuzzy_first.add_translation("Hello", "Hallo");
+
+  Dictionary merged;
+  merged.add_translation("Hello", "Hallo");
+  merged.add_translation("Bye", "Tschüss");
+  Dictionary other;
+  other.add_fuzzy_translation("Hello", "Servus");
+  merged.merge(other);
+
+  if (!check_fuzzy(fuzzy_last, "Servus", "Hallo", "fuzzy duplicate") ||
+      !check_fuzzy(fuzzy_first, "Hallo", "Hallo", "finished duplicate") ||
+      !check_fuzzy(merged, "Servus", "Hallo", "merge"))
+    return false;
+
+  fuzzy_last.freeze(true);
+  return check_fuzzy(fuzzy_last, "Servus", "Hallo", "freeze");
+}
+
+/** Translates \a message with and without fuzzy translations, both
+    along the fallback chain and with flattened fallbacks, which have
+    to give the same result */
+bool test_fuzzy_fallback(const char* directory, const Language& language, const char* message)
+{
+  std::string results[2][2];
+  for(int flatten = 0; flatten < 2; ++flatten)
+  {
+    DictionaryManager manager(std::unique_ptr<tinygettext::FileSystem>(new UnixFileSystem));
+    manager.set_flatten_fallbacks(flatten != 0);
+    manager.add_directory(directory);
+    for(int use_fuzzy = 0; use_fuzzy < 2; ++use_fuzzy)
+    {
+      manager.set_use_fuzzy(use_fuzzy != 0);
+      results[flatten][use_fuzzy] = manager.get_dictionary(language).translate(message);
+    }
+  }
+
+  std::cout << "With fuzzy:    '" << results[0][1] << "' (flattened: '" << results[1][1] << "')" << std::endl;
+  std::cout << "Without fuzzy: '" << results[0][0] << "' (flattened: '" << results[1][0] << "')" << std::endl;
+  return results[0][0] == results[1][0] && results[0][1] == results[1][1];
+}
+
+typedef std::map<std::string, std::vector<std::string> > Translations;
+
+/** All translations of \a dict, the keys of the ones with a context
+    are joined like in EntryTable */
+Translations get_translations(Dictionary& dict, bool use_fuzzy)
+{
+  Translations result;
+  dict.set_use_fuzzy(use_fuzzy);
+  dict.foreach([&result](const std::string& msgid, const std::vector<std::string>& msgstrs) {
+    result[msgid] = msgstrs;
+  });
+  dict.foreach_ctxt([&result](const std::string& msgctxt, const std::string& msgid, const std::vector<std::string>& msgstrs) {
+    result[msgctxt + EntryTable::ctxt_separator + msgid] = msgstrs;
+  });
+  dict.set_use_fuzzy(true);
+  return result;
+}
+
+/** Compares the translations of \a dict to those of \a expected, with
+    fuzzy translations enabled and disabled */
+bool same_translations(Dictionary& dict, Dictionary& expected)
+{
+  return (get_translations(dict, true) == get_translations(expected, true) &&
+          get_translations(dict, false) == get_translations(expected, false));
+}
+
+bool read_file(const std::string& filename, std::string& text)
+{
+  std::ifstream in(filename.c_str());
+  if (!in)
+    return false;
+  text.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  return true;
+}
+
+std::vector<std::string> logged;
+
+void log_callback(const std::string& str)
+{
+  logged.push_back(str);
+}
+
+/** Parses \a filename once collecting its diagnostics and once
+    letting the parser log them, both have to give the same
+    dictionary and the same messages, and nothing may be logged while
+    the diagnostics are collected */
+bool test_diagnostics(const std::string& filename)
+{
+  std::string text;
+  if (!read_file(filename, text))
+  {
+    std::cout << "diagnostics: couldn't open " << filename << std::endl;
+    return false;
+  }
+
+  Log::set_log_warning_callback(log_callback);
+  Log::set_log_error_callback(log_callback);
+
+  logged.clear();
+  std::vector<PODiagnostic> diagnostics;
+  Dictionary collected;
+  POParser::parse(filename, text, collected, &diagnostics);
+  const std::vector<std::string> logged_while_collecting = logged;
+
+  logged.clear();
+  for(std::vector<PODiagnostic>::const_iterator d = diagnostics.begin(); d != diagnostics.end(); ++d)
+    POParser::log(*d);
+  const std::vector<std::string> expected = logged;
+
+  logged.clear();
+  Dictionary dict;
+  POParser::parse(filename, text, dict);
+
+  Log::set_log_warning_callback(Log::default_log_callback);
+  Log::set_log_error_callback(Log::default_log_callback);
+
+  for(std::vector<PODiagnostic>::const_iterator d = diagnostics.begin(); d != diagnostics.end(); ++d)
+  {
+    std::cout << d->line_number << ": " << (d->error ? "error" : "warning") << " " << d->code
+              << ": " << d->message << std::endl;
+  }
+
+  if (!logged_while_collecting.empty())
+  {
+    std::cout << "diagnostics: logged while collecting: " << logged_while_collecting[0];
+    return false;
+  }
+  else if (logged != expected)
+  {
+    std::cout << "diagnostics: " << logged.size() << " messages logged instead of "
+              << expected.size() << " diagnostics" << std::endl;
+    return false;
+  }
+  else if (!same_translations(collected, dict))
+  {
+    std::cout << "diagnostics: the translations differ" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool same_diagnostics(const std::vector<PODiagnostic>& lhs, const std::vector<PODiagnostic>& rhs)
+{
+  if (lhs.size() != rhs.size())
+    return false;
+  for(size_t i = 0; i < lhs.size(); ++i)
+  {
+    if (lhs[i].line_number != rhs[i].line_number || lhs[i].code != rhs[i].code ||
+        lhs[i].error != rhs[i].error || lhs[i].message != rhs[i].message || lhs[i].line != rhs[i].line)
+      return false;
+  }
+  return true;
+}
+
+/** Parses \a filename split into 2 to 16 chunks, which has to give
+    the same translations and diagnostics as parsing it in one go */
+bool test_chunks(const std::string& filename)
+{
+  std::string text;
+  if (!read_file(filename, text))
+  {
+    std::cout << "chunks: couldn't open " << filename << std::endl;
+    return false;
+  }
+
+  std::vector<PODiagnostic> expected_diagnostics;
+  Dictionary expected;
+  POParser::parse(filename, text, expected, &expected_diagnostics);
+
+  ThreadPool pool(4);
+  for(size_t num_chunks = 2; num_chunks <= 16; ++num_chunks)
+  {
+    std::vector<PODiagnostic> diagnostics;
+    Dictionary dict;
+    POParser::parse(filename, text, dict, pool, num_chunks, &diagnostics);
+    if (!same_diagnostics(diagnostics, expected_diagnostics))
+    {
+      std::cout << "chunks: " << filename << ": the diagnostics differ with " << num_chunks << " chunks" << std::endl;
+      return false;
+    }
+    if (!same_translations(dict, expected))
+    {
+      std::cout << "chunks: " << filename << ": the translations differ with " << num_chunks << " chunks" << std::endl;
+      return false;
+    }
+  }
+
+  std::cout << "chunks: " << filename << ": " << expected_diagnostics.size() << " diagnostics: ok" << std::endl;
+  return true;
+}
+
+/** The changes reported by the watchers of a MemoryFileSystem, the
+    test reports a change by calling notify() */
+struct MemoryChanges
+{
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::vector<std::string> files;
+  bool stopped = false;
+
+  void notify(const std::string& filename)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    files.push_back(filename);
+    cond.notify_all();
+  }
+};
+
+class MemoryFileWatcher : public FileWatcher
+{
+private:
+  std::shared_ptr<MemoryChanges> changes;
+
+public:
+  MemoryFileWatcher(std::shared_ptr<MemoryChanges> changes_) : changes(std::move(changes_)) {}
+
+  void add_directory(const std::string&) override {}
+  void remove_directory(const std::string&) override {}
+
+  bool wait(int timeout_ms, std::vector<std::string>& changed, bool& /*overflow*/) override
+  {
+    std::unique_lock<std::mutex> lock(changes->mutex);
+    auto ready = [this] { return changes->stopped || !changes->files.empty(); };
+    if (timeout_ms < 0)
+      changes->cond.wait(lock, ready);
+    else
+      changes->cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready);
+
+    if (changes->stopped)
+      return false;
+    changed.insert(changed.end(), changes->files.begin(), changes->files.end());
+    changes->files.clear();
+    return true;
+  }
+
+  void stop() override
+  {
+    std::lock_guard<std::mutex> lock(changes->mutex);
+    changes->stopped = true;
+    changes->cond.notify_all();
+  }
+};
+
+/** A FileSystem with the files held in memory, changed through a
+    shared map while a DictionaryManager uses it. It doesn't know
+    modification times and records the files opened. Given \a
+    changes, it can be watched. */
+class MemoryFileSystem : public FileSystem
+{
+public:
+  typedef std::map<std::string, std::string> Files;
+
+private:
+  std::shared_ptr<Files> files;
+  std::shared_ptr<MemoryChanges> changes;
+  std::mutex mutex;
+  std::vector<std::string> opened;
+
+public:
+  MemoryFileSystem(std::shared_ptr<Files> files_, std::shared_ptr<MemoryChanges> changes_ = nullptr) :
+    files(std::move(files_)), changes(std::move(changes_)), mutex(), opened() {}
+
+  std::vector<std::string> get_opened()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return opened;
+  }
+
+  std::vector<std::string> open_directory(const std::string& pathname) override
+  {
+    std::vector<std::string> result;
+    const std::string prefix = pathname + "/";
+    for(Files::const_iterator i = files->begin(); i != files->end(); ++i)
+    {
+      if (i->first.compare(0, prefix.size(), prefix) == 0)
+        result.push_back(i->first.substr(prefix.size()));
+    }
+    return result;
+  }
+
+  std::unique_ptr<std::istream> open_file(const std::string& filename) override
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      opened.push_back(filename);
+    }
+    Files::const_iterator i = files->find(filename);
+    if (i == files->end())
+      return std::unique_ptr<std::istream>();
+    return std::unique_ptr<std::istream>(new std::istringstream(i->second));
+  }
+
+  std::unique_ptr<FileWatcher> create_watcher() override
+  {
+    if (!changes)
+      return std::unique_ptr<FileWatcher>();
+    return std::unique_ptr<FileWatcher>(new MemoryFileWatcher(changes));
+  }
+};
+
+std::string po_file(const char* msgid, const char* msgstr)
+{
+  return (std::string("msgid \"\"\nmsgstr \"\"\n\"Content-Type: text/plain; charset=UTF-8\\n\"\n\n") +
+          "msgid \"" + msgid + "\"\nmsgstr \"" + msgstr + "\"\n");
+}
+
+/** Without modification times, directories are scanned and files
+    parsed again whenever the manager needs them */
+bool test_rescan()
+{
+  std::shared_ptr<MemoryFileSystem::Files> files(new MemoryFileSystem::Files);
+  (*files)["mem/de.po"] = po_file("Hello", "Hallo");
+
+  DictionaryManager manager(std::unique_ptr<FileSystem>(new MemoryFileSystem(files)));
+  manager.add_directory("mem");
+  const std::string before = manager.get_dictionary(Language::from_name("de")).translate("Hello");
+
+  (*files)["mem/de.po"] = po_file("Hello", "Servus");
+  (*files)["mem/fr.po"] = po_file("Hello", "Bonjour");
+  (*files)["more/de.po"] = po_file("Bye", "Tschüss");
+  const bool found = manager.get_languages().count(Language::from_name("fr")) != 0;
+
+  // rebuilds de from both directories
+  manager.add_directory("more");
+  const std::string after = manager.get_dictionary(Language::from_name("de")).translate("Hello");
+
+  if (before != "Hallo" || after != "Servus" || !found)
+  {
+    std::cout << "rescan: '" << before << "', '" << after << "', "
+              << (found ? "found" : "didn't find") << " the new file" << std::endl;
+    return false;
+  }
+
+  std::cout << "rescan: ok" << std::endl;
+  return true;
+}
+
+bool check_snapshots(DictionaryManager& manager, std::shared_ptr<const Dictionary> (&snapshots)[3],
+                     const bool (&rebuilt)[3], const char* step)
+{
+  const char* names[] = { "de", "de_AT", "fr" };
+  bool ok = true;
+  for(int i = 0; i < 3; ++i)
+  {
+    std::shared_ptr<const Dictionary> snapshot = manager.get_snapshot(Language::from_name(names[i]));
+    if ((snapshot != snapshots[i]) != rebuilt[i])
+    {
+      std::cout << "directories: " << step << ": " << names[i] << " was "
+                << (rebuilt[i] ? "kept" : "rebuilt") << std::endl;
+      ok = false;
+    }
+    snapshots[i] = snapshot;
+  }
+  return ok;
+}
+
+/** Adding or removing a directory only rebuilds the languages with a
+    file in it and the ones falling back to them, also while other
+    threads are translating */
+bool test_directories()
+{
+  std::shared_ptr<MemoryFileSystem::Files> files(new MemoryFileSystem::Files);
+  (*files)["mem/de.po"] = po_file("Hello", "Hallo");
+  (*files)["mem/de_AT.po"] = po_file("Bye", "Servus");
+  (*files)["mem/fr.po"] = po_file("Hello", "Bonjour");
+  (*files)["more/de.po"] = po_file("Hello", "Guten Tag");
+
+  DictionaryManager manager(std::unique_ptr<FileSystem>(new MemoryFileSystem(files)));
+  manager.add_directory("mem");
+
+  std::shared_ptr<const Dictionary> snapshots[3];
+  const bool all[3] = { true, true, true };
+  const bool de_only[3] = { true, true, false };
+  if (!check_snapshots(manager, snapshots, all, "load"))
+    return false;
+
+  std::atomic<bool> done(false);
+  std::atomic<int> wrong(0);
+  std::thread reader([&manager, &done, &wrong]() {
+    while (!done)
+    {
+      const std::string de = manager.get_translator(Language::from_name("de_AT")).translate("Hello");
+      const std::string fr = manager.get_translator(Language::from_name("fr")).translate("Hello");
+      if ((de != "Hallo" && de != "Guten Tag") || fr != "Bonjour" ||
+          !manager.get_languages().count(Language::from_name("fr")))
+        wrong += 1;
+    }
+  });
+
+  bool ok = true;
+  for(int i = 0; i < 50 && ok; ++i)
+  {
+    manager.add_directory("more", true);
+    ok = check_snapshots(manager, snapshots, de_only, "add_directory");
+    if (ok && manager.get_dictionary(Language::from_name("de_AT")).translate("Hello") != "Guten Tag")
+    {
+      std::cout << "directories: add_directory: de_AT doesn't use the new directory" << std::endl;
+      ok = false;
+    }
+
+    manager.remove_directory("more");
+    ok = ok && check_snapshots(manager, snapshots, de_only, "remove_directory");
+  }
+
+  done = true;
+  reader.join();
+
+  if (wrong != 0)
+  {
+    std::cout << "directories: " << wrong << " wrong translations while changing directories" << std::endl;
+    return false;
+  }
+  if (ok)
+    std::cout << "directories: ok" << std::endl;
+  return ok;
+}
+
+/** load_async() resolves the future and calls each callback with the
+    loaded dictionary, a second request while loading shares the load
+    and one for a loaded language is answered right away */
+bool test_load_async()
+{
+  std::shared_ptr<MemoryFileSystem::Files> files(new MemoryFileSystem::Files);
+  (*files)["mem/de.po"] = po_file("Hello", "Hallo");
+  (*files)["mem/de_AT.po"] = po_file("Bye", "Servus");
+
+  DictionaryManager manager(std::unique_ptr<FileSystem>(new MemoryFileSystem(files)));
+  manager.add_directory("mem");
+
+  const Language de_AT = Language::from_name("de_AT");
+  std::mutex mutex;
+  std::vector<std::pair<Language, const Dictionary*> > called;
+  auto callback = [&mutex, &called](const Language& language, std::shared_ptr<const Dictionary> dict) {
+    std::lock_guard<std::mutex> lock(mutex);
+    called.push_back(std::make_pair(language, dict.get()));
+  };
+  auto num_called = [&mutex, &called]() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return called.size();
+  };
+
+  DictionaryManager::LoadFuture first = manager.load_async(de_AT, callback);
+  DictionaryManager::LoadFuture second = manager.load_async(de_AT, callback);
+  std::shared_ptr<const Dictionary> dict = first.get();
+
+  // the callbacks run after the future is resolved
+  const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (num_called() < 2 && std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  if (!dict || second.get() != dict || num_called() != 2)
+  {
+    std::cout << "load_async: " << num_called() << " callbacks for the first two requests" << std::endl;
+    return false;
+  }
+
+  const size_t loading_calls = num_called();
+  std::shared_ptr<const Dictionary> loaded = manager.load_async(de_AT, callback).get();
+  if (loaded != dict || num_called() != loading_calls + 1)
+  {
+    std::cout << "load_async: the loaded language wasn't answered right away" << std::endl;
+    return false;
+  }
+
+  for(size_t i = 0; i < called.size(); ++i)
+  {
+    if (called[i].first != de_AT || called[i].second != dict.get())
+    {
+      std::cout << "load_async: callback " << i << " got " << called[i].first.str() << std::endl;
+      return false;
+    }
+  }
+
+  if (dict->translate("Bye") != "Servus" || dict->translate("Hello") != "Hallo" ||
+      manager.get_snapshot(de_AT) != dict)
+  {
+    std::cout << "load_async: '" << dict->translate("Bye") << "', '" << dict->translate("Hello")
+              << "' instead of 'Servus', 'Hallo'" << std::endl;
+    return false;
+  }
+
+  std::cout << "load_async: ok" << std::endl;
+  return true;
+}
+
+/** preload() loads each language once and only starts a language
+    once its fallback is loaded, while get_dictionary() would parse a
+    language before its fallback */
+bool test_preload()
+{
+  std::shared_ptr<MemoryFileSystem::Files> files(new MemoryFileSystem::Files);
+  (*files)["mem/de.po"] = po_file("Hello", "Hallo");
+  (*files)["mem/de_AT.po"] = po_file("Bye", "Servus");
+  (*files)["mem/de_CH.po"] = po_file("Thanks", "Merci");
+  (*files)["mem/fr.po"] = po_file("Hello", "Bonjour");
+
+  for(int own_executor = 0; own_executor < 2; ++own_executor)
+  {
+    std::unique_ptr<MemoryFileSystem> owned(new MemoryFileSystem(files));
+    MemoryFileSystem* filesystem = owned.get();
+    DictionaryManager manager(std::move(owned));
+    manager.set_fallback(Language::from_name("de_CH"), Language::from_name("de_AT"));
+    manager.add_directory("mem");
+
+    const std::set<Language> languages = { Language::from_name("de_CH"), Language::from_name("fr") };
+    if (own_executor)
+    {
+      ThreadPool pool(4);
+      manager.preload(languages, pool);
+    }
+    else
+    {
+      manager.preload(languages);
+    }
+
+    // nothing is left to be loaded
+    const std::string translated = manager.get_dictionary(Language::from_name("de_CH")).translate("Hello");
+
+    std::vector<std::string> de_order;
+    const std::vector<std::string> opened = filesystem->get_opened();
+    for(std::vector<std::string>::const_iterator i = opened.begin(); i != opened.end(); ++i)
+    {
+      if (i->compare(0, 6, "mem/de") == 0)
+        de_order.push_back(*i);
+    }
+
+    const std::vector<std::string> expected = { "mem/de.po", "mem/de_AT.po", "mem/de_CH.po" };
+    if (opened.size() != 4 || de_order != expected || translated != "Hallo")
+    {
+      std::cout << "preload: opened";
+      for(std::vector<std::string>::const_iterator i = opened.begin(); i != opened.end(); ++i)
+        std::cout << " " << *i;
+      std::cout << ", translated '" << translated << "'" << std::endl;
+      return false;
+    }
+  }
+
+  std::cout << "preload: ok" << std::endl;
+  return true;
+}
+
+bool check_charset(const std::shared_ptr<const Dictionary>& dict, const char* msgid, const char* expected,
+                   const char* step)
+{
+  const std::string result = dict ? dict->translate(msgid) : std::string("(null)");
+  if (result != expected)
+  {
+    std::cout << "charset: " << step << ": '" << result << "' instead of '" << expected << "'" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+/** get_snapshot() with a charset converts the dictionary and its
+    fallback, the view is made once per charset and also used once
+    the manager is set to that charset, without parsing anything
+    again */
+bool test_charset_snapshots()
+{
+  std::shared_ptr<MemoryFileSystem::Files> files(new MemoryFileSystem::Files);
+  (*files)["mem/de.po"] = po_file("Bye", "Tschüss");
+  (*files)["mem/de_AT.po"] = po_file("Hello", "Grüß Gott");
+
+  std::unique_ptr<MemoryFileSystem> owned(new MemoryFileSystem(files));
+  MemoryFileSystem* filesystem = owned.get();
+  DictionaryManager manager(std::move(owned));
+  manager.add_directory("mem");
+
+  const Language de_AT = Language::from_name("de_AT");
+  std::shared_ptr<const Dictionary> latin1 = manager.get_snapshot(de_AT, "ISO-8859-1");
+  std::shared_ptr<const Dictionary> utf8 = manager.get_snapshot(de_AT);
+
+  if (!check_charset(latin1, "Hello", "Gr\xfc\xdf Gott", "ISO-8859-1") ||
+      !check_charset(latin1, "Bye", "Tsch\xfcss", "ISO-8859-1 fallback") ||
+      !check_charset(utf8, "Hello", "Grüß Gott", "UTF-8"))
+    return false;
+
+  Log::set_log_warning_callback(log_callback);
+  std::shared_ptr<const Dictionary> unknown = manager.get_snapshot(de_AT, "NO-SUCH-CHARSET");
+  Log::set_log_warning_callback(Log::default_log_callback);
+  if (!check_charset(unknown, "Hello", "Grüß Gott", "unknown charset"))
+    return false;
+
+  if (manager.get_snapshot(de_AT, "ISO-8859-1") != latin1 || manager.get_snapshot(de_AT, "UTF-8") != utf8)
+  {
+    std::cout << "charset: the view was made again" << std::endl;
+    return false;
+  }
+
+  manager.set_charset("ISO-8859-1");
+  if (manager.get_snapshot(de_AT) != latin1)
+  {
+    std::cout << "charset: set_charset() didn't use the view" << std::endl;
+    return false;
+  }
+
+  if (filesystem->get_opened().size() != 2)
+  {
+    std::cout << "charset: " << filesystem->get_opened().size() << " files opened instead of 2" << std::endl;
+    return false;
+  }
+
+  std::cout << "charset: ok" << std::endl;
+  return true;
+}
+
+bool write_file(const std::string& filename, const std::string& text)
+{
+  std::ofstream out(filename.c_str(), std::ios::binary);
+  out << text;
+  return static_cast<bool>(out);
+}
+
+/** Rewrites a .po file while the manager watches its directory, the
+    language is reloaded in the background and published, while a
+    language whose file didn't change keeps its dictionary */
+bool test_watch()
+{
+  char tmpl[] = "/tmp/tinygettext_watch.XXXXXX";
+  if (!mkdtemp(tmpl))
+  {
+    std::cout << "watch: couldn't create a directory: " << strerror(errno) << std::endl;
+    return false;
+  }
+  const std::string directory = tmpl;
+  write_file(directory + "/de.po", po_file("Hello", "Hallo"));
+  write_file(directory + "/fr.po", po_file("Hello", "Bonjour"));
+
+  bool ok = true;
+  {
+    DictionaryManager manager(std::unique_ptr<FileSystem>(new UnixFileSystem));
+    manager.set_reload_delay(20);
+    manager.set_watch_files(true);
+    manager.add_directory(directory);
+
+    if (!manager.get_watch_files())
+    {
+      std::cout << "watch: not supported" << std::endl;
+    }
+    else
+    {
+      const Language de = Language::from_name("de");
+      const Language fr = Language::from_name("fr");
+      std::shared_ptr<const Dictionary> old_de = manager.get_snapshot(de);
+      std::shared_ptr<const Dictionary> old_fr = manager.get_snapshot(fr);
+
+      write_file(directory + "/de.po", po_file("Hello", "Servus"));
+
+      const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+      std::shared_ptr<const Dictionary> new_de = manager.get_snapshot(de);
+      while (new_de == old_de && std::chrono::steady_clock::now() < deadline)
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        new_de = manager.get_snapshot(de);
+      }
+
+      if (new_de == old_de)
+      {
+        std::cout << "watch: de wasn't reloaded" << std::endl;
+        ok = false;
+      }
+      else if (new_de->translate("Hello") != "Servus" || old_de->translate("Hello") != "Hallo")
+      {
+        std::cout << "watch: '" << new_de->translate("Hello") << "' after and '"
+                  << old_de->translate("Hello") << "' before the change" << std::endl;
+        ok = false;
+      }
+      else if (manager.get_snapshot(fr) != old_fr)
+      {
+        std::cout << "watch: fr was reloaded as well" << std::endl;
+        ok = false;
+      }
+    }
+  }
+
+  remove((directory + "/de.po").c_str());
+  remove((directory + "/fr.po").c_str());
+  rmdir(directory.c_str());
+
+  if (ok)
+    std::cout << "watch: ok" << std::endl;
+  return ok;
+}
+
+/** A version of the .po file used by test_incremental() */
+struct IncrementalStep
+{
+  const char* name;
+  std::string text;
+
+  /** Whether POBlockIndex::build() accepts the text */
+  bool indexable;
+
+  /** Whether the file is patched instead of parsed as a whole */
+  bool incremental;
+
+  /** The keys POBlockIndex::diff() reports as removed and changed */
+  std::set<std::string> removed;
+  std::set<std::string> changed;
+};
+
+std::string incremental_po(const std::string& header, const std::string& entries)
+{
+  return (std::string("msgid \"\"\nmsgstr \"\"\n\"Content-Type: text/plain; charset=UTF-8\\n\"\n"
+                      "\"Plural-Forms: nplurals=2; plural=(n != 1);\\n\"\n") + header + "\n" + entries);
+}
+
+std::set<std::string> get_keys(Dictionary& dict)
+{
+  std::set<std::string> keys;
+  const std::map<std::string, std::vector<std::string> > translations = get_translations(dict, true);
+  for(std::map<std::string, std::vector<std::string> >::const_iterator i = translations.begin(); i != translations.end(); ++i)
+  {
+    keys.insert(i->first);
+  }
+  return keys;
+}
+
+size_t count_logged(const char* message)
+{
+  size_t count = 0;
+  for(std::vector<std::string>::const_iterator i = logged.begin(); i != logged.end(); ++i)
+  {
+    if (i->find(message) != std::string::npos)
+      count += 1;
+  }
+  return count;
+}
+
+/** Edits a watched file in ways that only need the changed entries
+    to be parsed, and in ways that need the whole file to be parsed
+    again. POBlockIndex has to find the changed entries and the
+    manager has to end up with the same translations as a full parse
+    of each version. Whether the file was patched is told by the
+    warning about the unknown escape in "Tab", which an unchanged
+    entry doesn't log again. */
+bool test_incremental()
+{
+  const std::string open = std::string("menu") + EntryTable::ctxt_separator + "Open";
+  const std::string toolbar_open = std::string("toolbar") + EntryTable::ctxt_separator + "Open";
+  const char* tab = "msgid \"Tab\"\nmsgstr \"Tab\\q\"\n\n";
+  const char* plural = "msgid \"file\"\nmsgid_plural \"files\"\nmsgstr[0] \"Datei\"\nmsgstr[1] \"Dateien\"\n\n";
+
+  const IncrementalStep steps[] = {
+    { "initial", incremental_po("", std::string(tab) +
+                                    "msgid \"Hello\"\nmsgstr \"Hallo\"\n\n"
+                                    "msgctxt \"menu\"\nmsgid \"Open\"\nmsgstr \"Öffnen\"\n\n" +
+                                    plural +
+                                    "msgid \"Bye\"\nmsgstr \"Tschüss\"\n"),
+      true, false, {}, {} },
+    { "ctxt", incremental_po("", std::string(tab) +
+                                 "msgid \"Hello\"\nmsgstr \"Hallo\"\n\n"
+                                 "msgctxt \"toolbar\"\nmsgid \"Open\"\nmsgstr \"Öffnen\"\n\n" +
+                                 plural +
+                                 "msgid \"Bye\"\nmsgstr \"Tschüss\"\n"),
+      true, true, { open }, { toolbar_open } },
+    { "plural", incremental_po("", std::string(tab) +
+                                   "msgid \"Hello\"\nmsgstr \"Hallo\"\n\n"
+                                   "msgctxt \"toolbar\"\nmsgid \"Open\"\nmsgstr \"Öffnen\"\n\n"
+                                   "msgid \"file\"\nmsgid_plural \"files\"\nmsgstr[0] \"Datei\"\nmsgstr[1] \"Dateien!\"\n\n"
+                                   "msgid \"Bye\"\nmsgstr \"Tschüss\"\n"),
+      true, true, { "file" }, { "file" } },
+    { "removal", incremental_po("", std::string(tab) +
+                                    "msgid \"Hello\"\nmsgstr \"Hallo\"\n\n"
+                                    "msgctxt \"toolbar\"\nmsgid \"Open\"\nmsgstr \"Öffnen\"\n\n"
+                                    "msgid \"file\"\nmsgid_plural \"files\"\nmsgstr[0] \"Datei\"\nmsgstr[1] \"Dateien!\"\n"),
+      true, true, { "Bye" }, {} },
+    { "header", incremental_po("\"Language: de\\n\"\n", std::string(tab) +
+                                                         "msgid \"Hello\"\nmsgstr \"Hallo\"\n\n" +
+                                                         plural),
+      true, false, {}, {} },
+    { "comment", incremental_po("\"Language: de\\n\"\n", std::string(tab) +
+                                                          "msgid \"Hello\"\nmsgstr \"Hallo\"\n\n" +
+                                                          plural +
+                                                          "msgid \"Bye\"\nmsgstr \"Tschüss\"\n"
+                                                          "#~ msgid \"Old\"\n#~ msgstr \"Alt\"\n"),
+      false, false, {}, {} },
+    // the last version couldn't be indexed, so there is nothing to
+    // compare this one to
+    { "recovered", incremental_po("\"Language: de\\n\"\n", std::string(tab) +
+                                                            "msgid \"Hello\"\nmsgstr \"Hallo\"\n\n" +
+                                                            plural),
+      true, false, {}, {} },
+    { "modified", incremental_po("\"Language: de\\n\"\n", std::string(tab) +
+                                                           "msgid \"Hello\"\nmsgstr \"Servus\"\n\n" +
+                                                           plural),
+      true, true, { "Hello" }, { "Hello" } },
+    { "duplicate", incremental_po("\"Language: de\\n\"\n", std::string(tab) +
+                                                            "msgid \"Hello\"\nmsgstr \"Servus\"\n\n" +
+                                                            plural +
+                                                            "msgid \"Hello\"\nmsgstr \"Grüß Gott\"\n"),
+      false, false, {}, {} },
+  };
+  const size_t step_count = sizeof(steps) / sizeof(steps[0]);
+
+  // the index on its own
+  POBlockIndex old;
+  bool old_indexed = false;
+  for(size_t s = 0; s < step_count; ++s)
+  {
+    const IncrementalStep& step = steps[s];
+    POBlockIndex index;
+    const bool indexed = index.build(step.text);
+    if (indexed != step.indexable)
+    {
+      std::cout << "incremental: " << step.name << ": build() returned " << indexed << std::endl;
+      return false;
+    }
+
+    POBlockIndex::Diff diff;
+    const bool patched = indexed && old_indexed && index.diff(old, step.text, diff);
+    if (patched != step.incremental)
+    {
+      std::cout << "incremental: " << step.name << ": diff() returned " << patched << std::endl;
+      return false;
+    }
+
+    if (patched)
+    {
+      // the dummy msgstrs of the removed keys may not be logged
+      std::vector<PODiagnostic> diagnostics;
+      Dictionary removed;
+      POParser::parse("de.po", diff.removed, removed, &diagnostics);
+      Dictionary changed;
+      POParser::parse("de.po", diff.changed, changed, &diagnostics);
+      if (get_keys(removed) != step.removed || get_keys(changed) != step.changed)
+      {
+        std::cout << "incremental: " << step.name << ": wrong diff:" << std::endl
+                  << diff.removed << "---" << std::endl << diff.changed;
+        return false;
+      }
+    }
+
+    old = index;
+    old_indexed = indexed;
+  }
+
+  // the manager reloading the file
+  std::shared_ptr<MemoryFileSystem::Files> files(new MemoryFileSystem::Files);
+  std::shared_ptr<MemoryChanges> changes(new MemoryChanges);
+  (*files)["mem/de.po"] = steps[0].text;
+
+  Log::set_log_warning_callback(log_callback);
+  Log::set_log_error_callback(log_callback);
+  logged.clear();
+
+  bool ok = true;
+  {
+    DictionaryManager manager(std::unique_ptr<FileSystem>(new MemoryFileSystem(files, changes)));
+    manager.set_reload_delay(1);
+    manager.set_watch_files(true);
+    manager.add_directory("mem");
+
+    const Language de = Language::from_name("de");
+    std::shared_ptr<const Dictionary> snapshot = manager.get_snapshot(de);
+    for(size_t s = 1; s < step_count && ok; ++s)
+    {
+      const IncrementalStep& step = steps[s];
+      logged.clear();
+      (*files)["mem/de.po"] = step.text;
+      changes->notify("mem/de.po");
+
+      const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+      std::shared_ptr<const Dictionary> reloaded = manager.get_snapshot(de);
+      while (reloaded == snapshot && std::chrono::steady_clock::now() < deadline)
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        reloaded = manager.get_snapshot(de);
+      }
+      snapshot = reloaded;
+
+      const size_t escapes = count_logged("unhandled escape");
+      Dictionary expected;
+      POParser::parse("mem/de.po", step.text, expected);
+      if (escapes != (step.incremental ? 0 : 1))
+      {
+        std::cout << "incremental: " << step.name << ": " << escapes << " warnings about the escape" << std::endl;
+        ok = false;
+      }
+      else if (!same_translations(manager.get_dictionary(de), expected))
+      {
+        std::cout << "incremental: " << step.name << ": translations differ from a full parse" << std::endl;
+        ok = false;
+      }
+    }
+  }
+
+  Log::set_log_warning_callback(Log::default_log_callback);
+  Log::set_log_error_callback(Log::default_log_callback);
+
+  if (ok)
+    std::cout << "incremental: ok" << std::endl;
+  return ok;
+}
+
+/** Feeds \a filename to a POParser in pieces of 1 byte and of odd
+    sizes, which has to give the same translations and diagnostics
+    as parsing it in one go */
+bool test_feed(const std::string& filename)
+{
+  std::string text;
+  if (!read_file(filename, text))
+  {
+    std::cout << "feed: couldn't open " << filename << std::endl;
+    return false;
+  }
+
+  std::vector<PODiagnostic> expected_diagnostics;
+  Dictionary expected;
+  POParser::parse(filename, text, expected, &expected_diagnostics);
+
+  const size_t piece_sizes[] = { 1, 3, 7, 13, 61, 509, 4093 };
+  for(size_t piece_size : piece_sizes)
+  {
+    std::vector<PODiagnostic> diagnostics;
+    Dictionary dict;
+    POParser parser(filename, dict, &diagnostics);
+    for(size_t pos = 0; pos < text.size(); pos += piece_size)
+      parser.feed(std::string_view(text).substr(pos, piece_size));
+    parser.finish();
+
+    if (!same_diagnostics(diagnostics, expected_diagnostics))
+    {
+      std::cout << "feed: " << filename << ": the diagnostics differ with pieces of " << piece_size << " bytes" << std::endl;
+      return false;
+    }
+    if (!same_translations(dict, expected))
+    {
+      std::cout << "feed: " << filename << ": the translations differ with pieces of " << piece_size << " bytes" << std::endl;
+      return false;
+    }
+  }
+
+  std::cout << "feed: " << filename << ": " << expected_diagnostics.size() << " diagnostics: ok" << std::endl;
+  return true;
+}
+
+bool check_plural(const std::string& result, const char* expected, const char* step)
+{
+  if (result != expected)
+  {
+    std::cout << "singular: " << step << ": '" << result << "' instead of '" << expected << "'" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+/** A translation without plural forms only replaces the first one of
+    an earlier entry with the same msgid and is only a collision if
+    that differs, both when added directly and in \a filename, which
+    is test/duplicates.po */
+bool test_singular_duplicates(const std::string& filename)
+{
+  Log::set_log_warning_callback(log_callback);
+  logged.clear();
+  Dictionary dict;
+  dict.set_plural_forms(PluralForms::from_string("Plural-Forms: nplurals=2; plural=(n != 1);"));
+  dict.add_translation("World", "Worlds", { "Welt", "Welten" });
+  dict.add_translation("World", "Welt");
+  const size_t logged_same = logged.size();
+  dict.add_translation("World", "Erde");
+  const size_t logged_different = logged.size();
+  Log::set_log_warning_callback(Log::default_log_callback);
+
+  if (logged_same != 0 || logged_different != 1)
+  {
+    std::cout << "singular: " << logged_same << " and " << logged_different
+              << " collisions logged instead of 0 and 1" << std::endl;
+    return false;
+  }
+
+  if (!check_plural(dict.translate_plural("World", "Worlds", 1), "Erde", "add_translation") ||
+      !check_plural(dict.translate_plural("World", "Worlds", 2), "Welten", "add_translation"))
+    return false;
+
+  std::string text;
+  if (!read_file(filename, text))
+  {
+    std::cout << "singular: couldn't open " << filename << std::endl;
+    return false;
+  }
+
+  std::vector<PODiagnostic> diagnostics;
+  Dictionary parsed;
+  POParser::parse(filename, text, parsed, &diagnostics);
+  parsed.set_use_fuzzy(false);
+  const std::string without_fuzzy = parsed.translate("World");
+  parsed.set_use_fuzzy(true);
+
+  if (!check_plural(without_fuzzy, "Erde", "parse without fuzzy") ||
+      !check_plural(parsed.translate("World"), "Globus", "parse") ||
+      !check_plural(parsed.translate_plural("World", "Worlds", 2), "Erden", "parse") ||
+      !check_plural(parsed.translate_ctxt("space", "World"), "All", "parse with context") ||
+      !check_plural(parsed.translate_ctxt_plural("space", "World", "Worlds", 2), "Welten", "parse with context"))
+    return false;
+
+  std::cout << "singular: ok" << std::endl;
+  return true;
+}
+
 } // namespace
 
 int main(int argc, char** argv)
@@ -196,6 +1468,100 @@ int main(int argc, char** argv)
       dict.foreach(print_msg);
       dict.foreach_ctxt(print_msg_ctxt);
     }
+    else if ((argc >= 4) && strcmp(argv[1], "misses") == 0)
+    {
+      const char* filename = argv[2];
+
+      std::shared_ptr<MissTracker> tracker = std::make_shared<MissTracker>();
+      Dictionary dict;
+      dict.set_miss_tracker(tracker);
+      read_dictionary(filename, dict);
+
+      for(int i = 3; i < argc; ++i)
+      {
+        dict.translate(argv[i]);
+      }
+      tracker->write_pot(std::cout);
+    }
+    else if ((argc == 2 || argc == 3) && strcmp(argv[1], "entry-table") == 0)
+    {
+      const int operations = (argc == 3) ? atoi(argv[2]) : 5000;
+      if (!test_entry_table(operations))
+        return EXIT_FAILURE;
+    }
+    else if (argc == 5 && strcmp(argv[1], "fuzzy") == 0)
+    {
+      Language language = Language::from_name(argv[3]);
+      if (!language)
+      {
+        std::cout << "Unknown language: " << argv[3] << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      if (!test_fuzzy_duplicates() || !test_fuzzy_fallback(argv[2], language, argv[4]))
+        return EXIT_FAILURE;
+    }
+    else if (argc == 3 && strcmp(argv[1], "diagnostics") == 0)
+    {
+      if (!test_diagnostics(argv[2]))
+        return EXIT_FAILURE;
+    }
+    else if (argc >= 3 && strcmp(argv[1], "chunks") == 0)
+    {
+      for(int i = 2; i < argc; ++i)
+      {
+        if (!test_chunks(argv[i]))
+          return EXIT_FAILURE;
+      }
+    }
+    else if (argc >= 3 && strcmp(argv[1], "feed") == 0)
+    {
+      for(int i = 2; i < argc; ++i)
+      {
+        if (!test_feed(argv[i]))
+          return EXIT_FAILURE;
+      }
+    }
+    else if (argc == 3 && strcmp(argv[1], "singular") == 0)
+    {
+      if (!test_singular_duplicates(argv[2]))
+        return EXIT_FAILURE;
+    }
+    else if (argc == 2 && strcmp(argv[1], "rescan") == 0)
+    {
+      if (!test_rescan())
+        return EXIT_FAILURE;
+    }
+    else if (argc == 2 && strcmp(argv[1], "directories") == 0)
+    {
+      if (!test_directories())
+        return EXIT_FAILURE;
+    }
+    else if (argc == 2 && strcmp(argv[1], "watch") == 0)
+    {
+      if (!test_watch())
+        return EXIT_FAILURE;
+    }
+    else if (argc == 2 && strcmp(argv[1], "load-async") == 0)
+    {
+      if (!test_load_async())
+        return EXIT_FAILURE;
+    }
+    else if (argc == 2 && strcmp(argv[1], "preload") == 0)
+    {
+      if (!test_preload())
+        return EXIT_FAILURE;
+    }
+    else if (argc == 2 && strcmp(argv[1], "charset") == 0)
+    {
+      if (!test_charset_snapshots())
+        return EXIT_FAILURE;
+    }
+    else if (argc == 2 && strcmp(argv[1], "incremental") == 0)
+    {
+      if (!test_incremental())
+        return EXIT_FAILURE;
+    }
     else
     {
       print_usage(argc, argv);